@@ -147,6 +147,7 @@ void config_init(struct config *config)
      */
     struct config_parser_event events[] = {
         /* clang-format off */
+        { "font", "atlas", &config->font.atlas, &mem_set_u32 },
         { "font", "path", &config->font.path, &mem_set_str },
         { "font", "size", &config->font.size, &mem_set_u32 },
         { "line-edit", "bg", &config->line_edit.bg, &mem_set_color },
@@ -158,6 +159,9 @@ void config_init(struct config *config)
         { "list-view", "fg", &config->list_view.fg, &mem_set_color },
         { "list-view", "fg-sel", &config->list_view.fg_sel, &mem_set_color },
         { "list-view", "lines", &config->list_view.lines, &mem_set_color },
+        { "list-view", "match", &config->list_view.match, &mem_set_color },
+        { "list-view", "match-sel", &config->list_view.match_sel,
+          &mem_set_color },
         { "list-view", "size", &config->list_view.size, &mem_set_u32 },
         { "widget", "frame", &config->widget.frame, &mem_set_color },
         { "widget", "line-width", &config->widget.line_width, &mem_set_u32 },
@@ -32,6 +32,7 @@ struct config {
     } widget;
 
     struct {
+        uint32_t atlas;
         const char *path;
         uint32_t size;
     } font;
@@ -45,6 +46,8 @@ struct config {
         uint32_t fg_sel;
         uint32_t bg1_sel;
         uint32_t bg2_sel;
+        uint32_t match;
+        uint32_t match_sel;
         uint32_t lines;
     } list_view;
 
@@ -0,0 +1,644 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "dfa.h"
+
+#include "util/macro.h"
+#include "util/xalloc.h"
+
+#define DFA_SYMBOL_BEGIN 256
+#define DFA_SYMBOL_END 257
+
+#define DFA_SET_WORDS (DFA_MAX_NODES / 64)
+
+enum {
+    DFA_NODE_CHAR,
+    DFA_NODE_BEGIN,
+    DFA_NODE_END,
+    DFA_NODE_SPLIT,
+    DFA_NODE_EPSILON,
+    DFA_NODE_MATCH,
+};
+
+/*
+ * A fragment of the NFA under construction. Its unconnected edges form a
+ * list: each one is identified by 'node * 2 + k' with 'k' selecting the
+ * 'out' or 'out1' edge and stores the identifier of the next one.
+ */
+struct dfa_frag {
+    int start;
+    int outs;
+};
+
+struct dfa_parser {
+    const char *ptr;
+    const char *end;
+    struct dfa_node *nodes;
+    int n_nodes;
+    int err;
+};
+
+static inline void set_add(uint64_t *set, int c)
+{
+    set[c / 64] |= (uint64_t) 1 << (c % 64);
+}
+
+static inline bool set_has(const uint64_t *set, int c)
+{
+    return (set[c / 64] >> (c % 64)) & 1;
+}
+
+static void set_add_range(uint64_t *set, int first, int last)
+{
+    for (int c = first; c <= last; ++c)
+        set_add(set, c);
+}
+
+static void set_invert(uint64_t *set)
+{
+    for (int i = 0; i < 4; ++i)
+        set[i] = ~set[i];
+}
+
+static int16_t *dfa_parser_edge(struct dfa_parser *parser, int id)
+{
+    struct dfa_node *node = parser->nodes + id / 2;
+
+    return (id & 0x01) ? &node->out1 : &node->out;
+}
+
+static void dfa_parser_patch(struct dfa_parser *parser, int outs, int target)
+{
+    while (outs >= 0) {
+        int16_t *edge = dfa_parser_edge(parser, outs);
+
+        outs = *edge;
+        *edge = (int16_t) target;
+    }
+}
+
+static int dfa_parser_append(struct dfa_parser *parser, int outs1, int outs2)
+{
+    int id = outs1;
+
+    if (outs1 < 0)
+        return outs2;
+
+    while (*dfa_parser_edge(parser, id) >= 0)
+        id = *dfa_parser_edge(parser, id);
+
+    *dfa_parser_edge(parser, id) = (int16_t) outs2;
+
+    return outs1;
+}
+
+static struct dfa_frag dfa_parser_node(struct dfa_parser *parser, int type)
+{
+    struct dfa_frag frag = { .start = 0, .outs = -1 };
+    struct dfa_node *node;
+
+    if (parser->n_nodes >= DFA_MAX_NODES) {
+        parser->err = -ENOSPC;
+        return frag;
+    }
+
+    frag.start = parser->n_nodes++;
+    frag.outs = frag.start * 2;
+
+    node = parser->nodes + frag.start;
+    memset(node, 0, sizeof(*node));
+
+    node->type = (uint8_t) type;
+    node->out = -1;
+    node->out1 = -1;
+
+    return frag;
+}
+
+/*
+ * Adds the characters of an escape sequence to 'set'. Returns true for a
+ * single literal character, which may still start a range.
+ */
+static bool dfa_parser_escape(int c, uint64_t *set)
+{
+    uint64_t escape[4] = { 0 };
+
+    switch (c) {
+    case 'd':
+    case 'D':
+        set_add_range(escape, '0', '9');
+        break;
+    case 'w':
+    case 'W':
+        set_add_range(escape, '0', '9');
+        set_add_range(escape, 'a', 'z');
+        set_add_range(escape, 'A', 'Z');
+        set_add(escape, '_');
+        break;
+    case 's':
+    case 'S':
+        set_add_range(escape, '\t', '\r');
+        set_add(escape, ' ');
+        break;
+    default:
+        set_add(set, c);
+        return true;
+    }
+
+    /* Only the escape's own characters are negated, not the whole class */
+    if (c == 'D' || c == 'W' || c == 'S')
+        set_invert(escape);
+
+    for (int i = 0; i < 4; ++i)
+        set[i] |= escape[i];
+
+    return false;
+}
+
+static void dfa_parser_class(struct dfa_parser *parser, uint64_t *set)
+{
+    bool invert = false, first = true;
+
+    if (parser->ptr < parser->end && *parser->ptr == '^') {
+        invert = true;
+        ++parser->ptr;
+    }
+
+    /* A leading ']' is taken literally */
+    while (parser->ptr < parser->end && (first || *parser->ptr != ']')) {
+        int c = (unsigned char) *parser->ptr++;
+        int last;
+
+        first = false;
+
+        if (c == '\\') {
+            if (parser->ptr >= parser->end)
+                break;
+
+            c = (unsigned char) *parser->ptr++;
+
+            /* Escaped character classes cannot be part of a range */
+            if (!dfa_parser_escape(c, set))
+                continue;
+        }
+
+        if (parser->end - parser->ptr < 2 || parser->ptr[0] != '-' ||
+            parser->ptr[1] == ']') {
+            set_add(set, c);
+            continue;
+        }
+
+        last = (unsigned char) parser->ptr[1];
+        parser->ptr += 2;
+
+        if (last < c) {
+            parser->err = -EINVAL;
+            return;
+        }
+
+        set_add_range(set, c, last);
+    }
+
+    if (parser->ptr >= parser->end) {
+        parser->err = -EINVAL;
+        return;
+    }
+
+    /* Skip the closing ']' */
+    ++parser->ptr;
+
+    if (invert)
+        set_invert(set);
+}
+
+static struct dfa_frag dfa_parser_alt(struct dfa_parser *parser);
+
+static struct dfa_frag dfa_parser_atom(struct dfa_parser *parser)
+{
+    struct dfa_frag frag;
+    int c;
+
+    c = (unsigned char) *parser->ptr++;
+
+    switch (c) {
+    case '(':
+        frag = dfa_parser_alt(parser);
+
+        if (parser->ptr >= parser->end || *parser->ptr != ')')
+            parser->err = -EINVAL;
+        else
+            ++parser->ptr;
+
+        return frag;
+    case '*':
+    case '+':
+    case '?':
+        /* Nothing to repeat */
+        parser->err = -EINVAL;
+        return dfa_parser_node(parser, DFA_NODE_EPSILON);
+    case '^':
+        return dfa_parser_node(parser, DFA_NODE_BEGIN);
+    case '$':
+        return dfa_parser_node(parser, DFA_NODE_END);
+    default:
+        break;
+    }
+
+    frag = dfa_parser_node(parser, DFA_NODE_CHAR);
+    if (parser->err)
+        return frag;
+
+    switch (c) {
+    case '.':
+        set_invert(parser->nodes[frag.start].set);
+        break;
+    case '[':
+        dfa_parser_class(parser, parser->nodes[frag.start].set);
+        break;
+    case '\\':
+        if (parser->ptr >= parser->end) {
+            parser->err = -EINVAL;
+            break;
+        }
+
+        c = (unsigned char) *parser->ptr++;
+        (void) dfa_parser_escape(c, parser->nodes[frag.start].set);
+        break;
+    default:
+        set_add(parser->nodes[frag.start].set, c);
+        break;
+    }
+
+    return frag;
+}
+
+static struct dfa_frag dfa_parser_repeat(struct dfa_parser *parser)
+{
+    struct dfa_frag frag, split;
+
+    frag = dfa_parser_atom(parser);
+
+    while (!parser->err && parser->ptr < parser->end) {
+        int c = *parser->ptr;
+
+        if (c != '*' && c != '+' && c != '?')
+            break;
+
+        ++parser->ptr;
+
+        split = dfa_parser_node(parser, DFA_NODE_SPLIT);
+        if (parser->err)
+            break;
+
+        parser->nodes[split.start].out = (int16_t) frag.start;
+
+        /* The 'out1' edge of the split node leaves the repetition */
+        split.outs = split.start * 2 + 1;
+
+        switch (c) {
+        case '*':
+            dfa_parser_patch(parser, frag.outs, split.start);
+            frag = split;
+            break;
+        case '+':
+            dfa_parser_patch(parser, frag.outs, split.start);
+            frag.outs = split.outs;
+            break;
+        default:
+            frag.start = split.start;
+            frag.outs = dfa_parser_append(parser, frag.outs, split.outs);
+            break;
+        }
+    }
+
+    return frag;
+}
+
+static struct dfa_frag dfa_parser_concat(struct dfa_parser *parser)
+{
+    struct dfa_frag frag = { .start = -1, .outs = -1 };
+
+    while (!parser->err && parser->ptr < parser->end) {
+        struct dfa_frag next;
+
+        if (*parser->ptr == '|' || *parser->ptr == ')')
+            break;
+
+        next = dfa_parser_repeat(parser);
+
+        if (frag.start < 0) {
+            frag = next;
+        } else {
+            dfa_parser_patch(parser, frag.outs, next.start);
+            frag.outs = next.outs;
+        }
+    }
+
+    /* An empty expression matches the empty string */
+    if (frag.start < 0)
+        frag = dfa_parser_node(parser, DFA_NODE_EPSILON);
+
+    return frag;
+}
+
+static struct dfa_frag dfa_parser_alt(struct dfa_parser *parser)
+{
+    struct dfa_frag frag, next, split;
+
+    frag = dfa_parser_concat(parser);
+
+    while (!parser->err && parser->ptr < parser->end && *parser->ptr == '|') {
+        ++parser->ptr;
+
+        next = dfa_parser_concat(parser);
+
+        split = dfa_parser_node(parser, DFA_NODE_SPLIT);
+        if (parser->err)
+            break;
+
+        parser->nodes[split.start].out = (int16_t) frag.start;
+        parser->nodes[split.start].out1 = (int16_t) next.start;
+
+        frag.start = split.start;
+        frag.outs = dfa_parser_append(parser, frag.outs, next.outs);
+    }
+
+    return frag;
+}
+
+/*
+ * Adds all nodes reachable from 'node' without consuming a symbol to
+ * 'set'. Only nodes which consume a symbol or accept are recorded.
+ */
+static void dfa_closure(const struct dfa *dfa, int node, uint64_t *set)
+{
+    uint64_t visited[DFA_SET_WORDS] = { 0 };
+    int16_t stack[DFA_MAX_NODES];
+    int n = 0;
+
+    stack[n++] = (int16_t) node;
+
+    while (n > 0) {
+        const struct dfa_node *ptr;
+
+        node = stack[--n];
+
+        if (node < 0 || set_has(visited, node))
+            continue;
+
+        set_add(visited, node);
+        ptr = dfa->nodes + node;
+
+        switch (ptr->type) {
+        case DFA_NODE_SPLIT:
+            stack[n++] = ptr->out1;
+            /* FALLTHROUGH */
+        case DFA_NODE_EPSILON:
+            stack[n++] = ptr->out;
+            break;
+        default:
+            set_add(set, node);
+            break;
+        }
+    }
+}
+
+/*
+ * Follows all anchors of the kind matching 'symbol' in 'set' which are
+ * not contained in 'done' until no new ones show up.
+ */
+static void dfa_follow_anchors(const struct dfa *dfa,
+                               int symbol,
+                               uint64_t *done,
+                               uint64_t *set)
+{
+    int type = (symbol == DFA_SYMBOL_BEGIN) ? DFA_NODE_BEGIN : DFA_NODE_END;
+    bool again = true;
+
+    while (again) {
+        again = false;
+
+        for (int i = 0; i < dfa->n_nodes; ++i) {
+            if (dfa->nodes[i].type != type || !set_has(set, i))
+                continue;
+
+            if (set_has(done, i))
+                continue;
+
+            set_add(done, i);
+            dfa_closure(dfa, dfa->nodes[i].out, set);
+
+            again = true;
+        }
+    }
+}
+
+static void dfa_flush(struct dfa *dfa)
+{
+    dfa->n_states = 0;
+    dfa->start_state = -1;
+}
+
+static int dfa_intern(struct dfa *dfa, const uint64_t *set)
+{
+    const size_t size = DFA_SET_WORDS * sizeof(*set);
+    const struct dfa_node *match;
+    int i;
+
+    for (i = 0; i < dfa->n_states; ++i) {
+        if (memcmp(dfa->sets[i], set, size) == 0)
+            return i;
+    }
+
+    /* The cache is full, start over and construct states as needed */
+    if (dfa->n_states >= DFA_MAX_STATES)
+        dfa_flush(dfa);
+
+    i = dfa->n_states++;
+
+    memcpy(dfa->sets[i], set, size);
+    memset(dfa->next[i], 0xff, sizeof(dfa->next[i]));
+
+    dfa->accept[i] = false;
+
+    for (int j = 0; j < dfa->n_nodes; ++j) {
+        match = dfa->nodes + j;
+
+        if (match->type == DFA_NODE_MATCH && set_has(set, j)) {
+            dfa->accept[i] = true;
+            break;
+        }
+    }
+
+    return i;
+}
+
+static int dfa_start(struct dfa *dfa)
+{
+    uint64_t set[DFA_SET_WORDS] = { 0 };
+
+    if (dfa->start_state < 0) {
+        dfa_closure(dfa, dfa->start, set);
+
+        dfa->start_state = dfa_intern(dfa, set);
+    }
+
+    return dfa->start_state;
+}
+
+static int dfa_step(struct dfa *dfa, int state, int symbol)
+{
+    uint64_t cur[DFA_SET_WORDS], done[DFA_SET_WORDS];
+    uint64_t set[DFA_SET_WORDS] = { 0 };
+    int next;
+
+    next = dfa->next[state][symbol];
+    if (likely(next >= 0))
+        return next;
+
+    memcpy(cur, dfa->sets[state], sizeof(cur));
+
+    for (int i = 0; i < dfa->n_nodes; ++i) {
+        const struct dfa_node *node = dfa->nodes + i;
+        bool ok;
+
+        if (!set_has(cur, i))
+            continue;
+
+        switch (node->type) {
+        case DFA_NODE_CHAR:
+            ok = symbol < 256 && set_has(node->set, symbol);
+            break;
+        case DFA_NODE_BEGIN:
+            ok = symbol == DFA_SYMBOL_BEGIN;
+            break;
+        case DFA_NODE_END:
+            ok = symbol == DFA_SYMBOL_END;
+            break;
+        default:
+            ok = false;
+            break;
+        }
+
+        if (ok)
+            dfa_closure(dfa, node->out, set);
+    }
+
+    /* A match may start at any position */
+    dfa_closure(dfa, dfa->start, set);
+
+    /*
+     * Anchors do not consume any input, so further anchors of the same
+     * kind reached through the first one are satisfied as well.
+     */
+    if (symbol == DFA_SYMBOL_BEGIN || symbol == DFA_SYMBOL_END) {
+        memcpy(done, cur, sizeof(done));
+        dfa_follow_anchors(dfa, symbol, done, set);
+    }
+
+    /* Interning the new state might flush the cache including 'state' */
+    next = dfa_intern(dfa, set);
+
+    if (state < dfa->n_states &&
+        memcmp(dfa->sets[state], cur, sizeof(cur)) == 0)
+        dfa->next[state][symbol] = (int16_t) next;
+
+    return next;
+}
+
+void dfa_init(struct dfa *dfa)
+{
+    struct dfa_parser parser;
+    struct dfa_frag frag;
+
+    memset(dfa, 0, sizeof(*dfa));
+
+    dfa->next = xmalloc(DFA_MAX_STATES * sizeof(*dfa->next));
+    dfa->sets = xmalloc(DFA_MAX_STATES * sizeof(*dfa->sets));
+    dfa->accept = xmalloc(DFA_MAX_STATES * sizeof(*dfa->accept));
+
+    /* The empty pattern matches everything */
+    memset(&parser, 0, sizeof(parser));
+    parser.nodes = dfa->nodes;
+
+    frag = dfa_parser_node(&parser, DFA_NODE_MATCH);
+
+    dfa->n_nodes = parser.n_nodes;
+    dfa->start = frag.start;
+
+    dfa_flush(dfa);
+}
+
+void dfa_destroy(struct dfa *dfa)
+{
+    free(dfa->next);
+    free(dfa->sets);
+    free(dfa->accept);
+}
+
+int dfa_compile(struct dfa *dfa, const char *pattern, size_t len)
+{
+    struct dfa_node nodes[DFA_MAX_NODES];
+    struct dfa_parser parser;
+    struct dfa_frag frag, match;
+
+    parser.ptr = pattern;
+    parser.end = pattern + len;
+    parser.nodes = nodes;
+    parser.n_nodes = 0;
+    parser.err = 0;
+
+    frag = dfa_parser_alt(&parser);
+
+    /* Anything left over is an unbalanced ')' */
+    if (!parser.err && parser.ptr < parser.end)
+        parser.err = -EINVAL;
+
+    match = dfa_parser_node(&parser, DFA_NODE_MATCH);
+
+    if (parser.err)
+        return parser.err;
+
+    dfa_parser_patch(&parser, frag.outs, match.start);
+
+    memcpy(dfa->nodes, nodes, parser.n_nodes * sizeof(*nodes));
+    dfa->n_nodes = parser.n_nodes;
+    dfa->start = frag.start;
+
+    dfa_flush(dfa);
+
+    return 0;
+}
+
+bool dfa_match(struct dfa *dfa, const char *str, size_t len)
+{
+    int state;
+
+    state = dfa_start(dfa);
+    state = dfa_step(dfa, state, DFA_SYMBOL_BEGIN);
+
+    for (size_t i = 0; i < len && !dfa->accept[state]; ++i)
+        state = dfa_step(dfa, state, (unsigned char) str[i]);
+
+    if (!dfa->accept[state])
+        state = dfa_step(dfa, state, DFA_SYMBOL_END);
+
+    return dfa->accept[state];
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DFA_H_
+#define DFA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DFA_MAX_NODES 256
+#define DFA_MAX_STATES 512
+
+/* All byte values plus two symbols marking the beginning and end of input */
+#define DFA_SYMBOLS 258
+
+struct dfa_node {
+    uint8_t type;
+    int16_t out;
+    int16_t out1;
+    uint64_t set[4];
+};
+
+/*
+ * Regular expression matcher. The pattern is compiled into a Thompson
+ * NFA which is turned into a DFA lazily while strings are matched: a DFA
+ * state is only constructed when it is reached for the first time.
+ * Constructed states are cached up to a fixed limit and the cache is
+ * simply flushed once it is full, so matching never needs more memory
+ * than allocated by dfa_init() and runs in linear time.
+ *
+ * Supported are literals, '.', bracket expressions, the escapes \d, \w,
+ * \s and their negations, grouping, alternation, the repetitions '*',
+ * '+' and '?' and the anchors '^' and '$'. A string matches if any of
+ * its substrings matches the pattern.
+ */
+struct dfa {
+    struct dfa_node nodes[DFA_MAX_NODES];
+    int n_nodes;
+    int start;
+
+    int16_t (*next)[DFA_SYMBOLS];
+    uint64_t (*sets)[DFA_MAX_NODES / 64];
+    bool *accept;
+    int n_states;
+    int start_state;
+};
+
+void dfa_init(struct dfa *dfa);
+
+void dfa_destroy(struct dfa *dfa);
+
+/*
+ * Compiles 'pattern'. Returns -EINVAL if the pattern is malformed and
+ * -ENOSPC if it is too complex. The previously compiled pattern is
+ * kept in both cases.
+ */
+int dfa_compile(struct dfa *dfa, const char *pattern, size_t len);
+
+bool dfa_match(struct dfa *dfa, const char *str, size_t len);
+
+#endif /* DFA_H_ */
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "glyph-cache.h"
+
+#include "util/die.h"
+#include "util/macro.h"
+
+static void glyph_cache_clear(struct glyph_cache *cache)
+{
+    for (int i = 0; i < cache->n_runs; ++i)
+        cairo_glyph_free(cache->runs[i].glyphs);
+
+    memset(cache->buckets, 0xff, sizeof(cache->buckets));
+
+    cache->n_runs = 0;
+    cache->head = -1;
+}
+
+static void glyph_cache_unlink(struct glyph_cache *cache, int index)
+{
+    struct glyph_run *run = &cache->runs[index];
+
+    if (run->next == index) {
+        cache->head = -1;
+        return;
+    }
+
+    cache->runs[run->prev].next = run->next;
+    cache->runs[run->next].prev = run->prev;
+
+    if (cache->head == index)
+        cache->head = run->next;
+}
+
+/* Makes the run the most recently used one */
+static void glyph_cache_touch(struct glyph_cache *cache, int index)
+{
+    struct glyph_run *run = &cache->runs[index];
+    int head = cache->head;
+
+    if (head == index)
+        return;
+
+    if (head < 0) {
+        run->prev = index;
+        run->next = index;
+    } else {
+        run->prev = cache->runs[head].prev;
+        run->next = head;
+
+        cache->runs[run->prev].next = index;
+        cache->runs[head].prev = index;
+    }
+
+    cache->head = index;
+}
+
+/* Removes the least recently used run and returns its slot */
+static int glyph_cache_evict(struct glyph_cache *cache)
+{
+    int index = cache->runs[cache->head].prev;
+    int *link = &cache->buckets[(unsigned int) cache->runs[index].key %
+                                GLYPH_CACHE_SIZE];
+
+    while (*link != index)
+        link = &cache->runs[*link].chain;
+
+    *link = cache->runs[index].chain;
+
+    glyph_cache_unlink(cache, index);
+    cairo_glyph_free(cache->runs[index].glyphs);
+
+    return index;
+}
+
+void glyph_cache_init(struct glyph_cache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    glyph_cache_clear(cache);
+}
+
+void glyph_cache_destroy(struct glyph_cache *cache)
+{
+    glyph_cache_clear(cache);
+
+    if (cache->font)
+        cairo_scaled_font_destroy(cache->font);
+}
+
+void glyph_cache_set_font(struct glyph_cache *cache, cairo_scaled_font_t *font)
+{
+    if (cache->font == font)
+        return;
+
+    glyph_cache_clear(cache);
+
+    /* Keep the font alive so it cannot be mistaken for a new one */
+    if (cache->font)
+        cairo_scaled_font_destroy(cache->font);
+
+    cache->font = cairo_scaled_font_reference(font);
+}
+
+const struct glyph_run *
+glyph_cache_get(struct glyph_cache *cache, int key, const char *str, int len)
+{
+    struct glyph_run *run;
+    cairo_status_t status;
+    int *bucket, index;
+
+    bucket = &cache->buckets[(unsigned int) key % GLYPH_CACHE_SIZE];
+
+    for (index = *bucket; index >= 0; index = cache->runs[index].chain) {
+        if (cache->runs[index].key == key)
+            break;
+    }
+
+    if (index >= 0) {
+        run = &cache->runs[index];
+
+        glyph_cache_unlink(cache, index);
+        glyph_cache_touch(cache, index);
+
+        if (run->str == str && run->len == len)
+            return run;
+
+        cairo_glyph_free(run->glyphs);
+    } else {
+        if (cache->n_runs < GLYPH_CACHE_SIZE)
+            index = cache->n_runs++;
+        else
+            index = glyph_cache_evict(cache);
+
+        run = &cache->runs[index];
+        run->key = key;
+        run->chain = *bucket;
+        *bucket = index;
+
+        glyph_cache_touch(cache, index);
+    }
+
+    run->str = str;
+    run->len = len;
+    run->glyphs = NULL;
+    run->n_glyphs = 0;
+
+    /* The glyphs are allocated by cairo to fit the whole string */
+    status = cairo_scaled_font_text_to_glyphs(cache->font,
+                                              0.0,
+                                              0.0,
+                                              str,
+                                              len,
+                                              &run->glyphs,
+                                              &run->n_glyphs,
+                                              NULL,
+                                              NULL,
+                                              NULL);
+    if (unlikely(status != CAIRO_STATUS_SUCCESS))
+        die("failed to lay out glyphs: %s\n", cairo_status_to_string(status));
+
+    return run;
+}
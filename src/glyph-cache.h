@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GLYPH_CACHE_H_
+#define GLYPH_CACHE_H_
+
+#include <cairo.h>
+
+#define GLYPH_CACHE_SIZE 256
+
+/* Glyphs of a string laid out relative to the origin of its row */
+struct glyph_run {
+    const char *str;
+    int len;
+    int key;
+
+    cairo_glyph_t *glyphs;
+    int n_glyphs;
+
+    /* Neighbours in the recently used list and next run in the bucket */
+    int prev;
+    int next;
+    int chain;
+};
+
+/*
+ * Least recently used glyph runs, e.g. one per item of a list. A run is
+ * laid out only once and translated to where it is drawn afterwards. A
+ * run whose string moved or changed is laid out again, so callers only
+ * need to pass keys which are stable for as long as their strings are.
+ */
+struct glyph_cache {
+    cairo_scaled_font_t *font;
+
+    struct glyph_run runs[GLYPH_CACHE_SIZE];
+    int buckets[GLYPH_CACHE_SIZE];
+    int n_runs;
+
+    /* The most recently used run, its predecessor is the least recent */
+    int head;
+};
+
+void glyph_cache_init(struct glyph_cache *cache);
+
+void glyph_cache_destroy(struct glyph_cache *cache);
+
+/* Drops all runs unless they were laid out with 'font' */
+void glyph_cache_set_font(struct glyph_cache *cache, cairo_scaled_font_t *font);
+
+const struct glyph_run *
+glyph_cache_get(struct glyph_cache *cache, int key, const char *str, int len);
+
+#endif /* GLYPH_CACHE_H_ */
@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "timer.h"
+
+#include "util/env.h"
+#include "util/macro.h"
+#include "util/string-util.h"
+#include "util/xalloc.h"
+
+#define HISTORY_MAGIC "crudebh1"
+
+struct history_header {
+    char magic[8];
+    uint32_t n_nodes;
+    uint32_t n_targets;
+    uint32_t strings_size;
+    uint32_t unused;
+};
+
+/* Prefix of a lookup string while the trie is rebuilt */
+struct history_entry {
+    char str[HISTORY_MAX_DEPTH];
+    int len;
+    const char *name;
+    uint32_t name_len;
+    uint32_t votes;
+};
+
+static uint32_t history_hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* Checks all indices and offsets of a mapped file before they are used */
+static bool history_valid(const void *map, size_t size)
+{
+    const struct history_header *header = map;
+    const struct history_node *nodes;
+    const struct history_target *targets;
+    uint64_t n;
+
+    if (size < sizeof(*header))
+        return false;
+
+    if (memcmp(header->magic, HISTORY_MAGIC, sizeof(header->magic)) != 0)
+        return false;
+
+    if (!header->n_nodes || header->n_nodes > HISTORY_MAX_NODES)
+        return false;
+
+    n = sizeof(*header);
+    n += (uint64_t) header->n_nodes * sizeof(*nodes);
+    n += (uint64_t) header->n_targets * sizeof(*targets);
+    n += header->strings_size;
+
+    if (n != size)
+        return false;
+
+    nodes = (const void *) (header + 1);
+    targets = (const void *) (nodes + header->n_nodes);
+
+    for (uint32_t i = 0; i < header->n_nodes; ++i) {
+        n = (uint64_t) nodes[i].child + nodes[i].n_children;
+        if (n > header->n_nodes)
+            return false;
+
+        n = nodes[i].target;
+        if (n != HISTORY_NONE && n >= header->n_targets)
+            return false;
+    }
+
+    for (uint32_t i = 0; i < header->n_targets; ++i) {
+        n = (uint64_t) targets[i].offset + targets[i].len;
+        if (n > header->strings_size)
+            return false;
+    }
+
+    return true;
+}
+
+static void history_map(struct history *hist)
+{
+    const struct history_header *header;
+    struct stat st;
+    void *map;
+    int fd, err;
+
+    fd = open(hist->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    err = fstat(fd, &st);
+    if (err < 0 || st.st_size <= 0) {
+        close(fd);
+        return;
+    }
+
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return;
+
+    /* A damaged history is simply discarded */
+    if (!history_valid(map, (size_t) st.st_size)) {
+        munmap(map, (size_t) st.st_size);
+        return;
+    }
+
+    header = map;
+
+    hist->map = map;
+    hist->map_size = (size_t) st.st_size;
+    hist->n_nodes = header->n_nodes;
+    hist->n_targets = header->n_targets;
+    hist->nodes = (const void *) (header + 1);
+    hist->targets = (const void *) (hist->nodes + hist->n_nodes);
+    hist->strings = (const void *) (hist->targets + hist->n_targets);
+}
+
+void history_init(struct history *hist)
+{
+    const char *path, *cache;
+    uint32_t size = 16;
+
+    TIMER_INIT_SIMPLE();
+
+    memset(hist, 0, sizeof(*hist));
+
+    /* The history is kept next to the cache */
+    cache = env_crudebox_cache();
+    if (cache) {
+        strconcat2a(&path, cache, ".history");
+    } else if (env_xdg_cache()) {
+        strconcat2a(&path, env_xdg_cache(), "/crudebox/history");
+    } else {
+        strconcat2a(&path, env_home(), "/.cache/crudebox/history");
+    }
+
+    hist->path = xstrdup(path);
+
+    history_map(hist);
+
+    while (size < 2 * hist->n_targets)
+        size *= 2;
+
+    hist->items = xmalloc(MAX(hist->n_targets, 1) * sizeof(*hist->items));
+    hist->table = xcalloc(size, sizeof(*hist->table));
+    hist->mask = size - 1;
+
+    for (uint32_t i = 0; i < hist->n_targets; ++i) {
+        const struct history_target *target = &hist->targets[i];
+        const char *name = hist->strings + target->offset;
+        uint32_t h = history_hash(name, target->len) & hist->mask;
+
+        while (hist->table[h])
+            h = (h + 1) & hist->mask;
+
+        /* Zero marks an empty slot */
+        hist->table[h] = i + 1;
+        hist->items[i] = -1;
+    }
+}
+
+void history_destroy(struct history *hist)
+{
+#ifdef MEM_NOLEAK
+    if (hist->map)
+        munmap(hist->map, hist->map_size);
+
+    free(hist->items);
+    free(hist->table);
+    free(hist->path);
+#else
+    (void) hist;
+#endif
+}
+
+void history_resolve(struct history *hist, const struct item_list *list)
+{
+    int n = item_list_size(list);
+
+    TIMER_INIT_SIMPLE();
+
+    for (int i = hist->n_scanned; i < n && hist->n_targets; ++i) {
+        const char *name = item_list_name(list, i);
+        uint32_t len = (uint32_t) item_list_name_len(list, i);
+        uint32_t h = history_hash(name, len) & hist->mask;
+
+        for (; hist->table[h]; h = (h + 1) & hist->mask) {
+            uint32_t k = hist->table[h] - 1;
+            const struct history_target *target = &hist->targets[k];
+
+            if (hist->items[k] >= 0 || target->len != len)
+                continue;
+
+            if (memcmp(hist->strings + target->offset, name, len) == 0) {
+                hist->items[k] = i;
+                break;
+            }
+        }
+    }
+
+    hist->n_scanned = n;
+}
+
+int history_lookup(const struct history *hist, const char *str, int len)
+{
+    uint32_t node = 0, target;
+
+    if (!hist->n_nodes || !len || len > HISTORY_MAX_DEPTH)
+        return -1;
+
+    for (int i = 0; i < len; ++i) {
+        const struct history_node *parent = &hist->nodes[node];
+        uint32_t lo = parent->child, hi = lo + parent->n_children;
+        unsigned char c = (unsigned char) str[i];
+
+        /* Children are sorted by their character */
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+
+            if (hist->nodes[mid].c < c)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == parent->child + parent->n_children || hist->nodes[lo].c != c)
+            return -1;
+
+        node = lo;
+    }
+
+    target = hist->nodes[node].target;
+    if (target == HISTORY_NONE)
+        return -1;
+
+    return hist->items[target];
+}
+
+static void history_collect(const struct history *hist,
+                            uint32_t node,
+                            struct history_entry *prefix,
+                            struct history_entry *entries,
+                            int *n)
+{
+    const struct history_node *parent = &hist->nodes[node];
+
+    /* Guard against cycles in a damaged file */
+    if (prefix->len >= HISTORY_MAX_DEPTH || *n >= HISTORY_MAX_NODES - 1)
+        return;
+
+    for (uint32_t i = 0; i < parent->n_children; ++i) {
+        const struct history_node *child = &hist->nodes[parent->child + i];
+        struct history_entry *entry = &entries[(*n)++];
+
+        memcpy(entry->str, prefix->str, (size_t) prefix->len);
+        entry->str[prefix->len] = (char) child->c;
+        entry->len = prefix->len + 1;
+        entry->name = NULL;
+        entry->name_len = 0;
+        entry->votes = 0;
+
+        if (child->target != HISTORY_NONE) {
+            const struct history_target *target;
+
+            target = &hist->targets[child->target];
+
+            entry->name = hist->strings + target->offset;
+            entry->name_len = target->len;
+            entry->votes = child->votes;
+        }
+
+        history_collect(hist, parent->child + i, entry, entries, n);
+
+        if (*n >= HISTORY_MAX_NODES - 1)
+            return;
+    }
+}
+
+static int history_entry_cmp(const void *a, const void *b)
+{
+    const struct history_entry *e1 = a, *e2 = b;
+
+    if (e1->len != e2->len)
+        return e1->len - e2->len;
+
+    return memcmp(e1->str, e2->str, (size_t) e1->len);
+}
+
+/* Entries are ordered by length first, so a trie level is contiguous */
+static struct history_entry *history_find(struct history_entry *entries,
+                                          int n,
+                                          const char *str,
+                                          int len)
+{
+    struct history_entry key;
+
+    memcpy(key.str, str, (size_t) len);
+    key.len = len;
+
+    return bsearch(&key, entries, (size_t) n, sizeof(key), &history_entry_cmp);
+}
+
+static void history_vote(struct history_entry *entry,
+                         const char *name,
+                         uint32_t len)
+{
+    bool same = entry->name && entry->name_len == len
+                && memcmp(entry->name, name, len) == 0;
+
+    /*
+     * Every choice is a vote for the chosen item and against the item
+     * remembered so far, which is replaced once it has no votes left.
+     */
+    if (same) {
+        entry->votes = MIN(entry->votes + 1, HISTORY_MAX_VOTES);
+    } else if (entry->votes > 1) {
+        --entry->votes;
+    } else {
+        entry->name = name;
+        entry->name_len = len;
+        entry->votes = 1;
+    }
+}
+
+static void history_write(const struct history *hist,
+                          struct history_entry *entries,
+                          int n)
+{
+    struct history_header header;
+    struct history_node *nodes;
+    struct history_target *targets;
+    uint32_t n_targets = 0, size = 0;
+    const char *tmp;
+    FILE *file;
+
+    nodes = xcalloc((size_t) n + 1, sizeof(*nodes));
+    targets = xmalloc(MAX(n, 1) * sizeof(*targets));
+
+    nodes[0].target = HISTORY_NONE;
+
+    /*
+     * Children of the same node are adjacent in the sorted entries, so
+     * each node only needs to know its first child. Names chosen for
+     * several prefixes are stored once.
+     */
+    for (int i = 0; i < n; ++i) {
+        struct history_entry *entry = &entries[i];
+        struct history_node *node = &nodes[i + 1];
+        uint32_t parent = 0;
+
+        if (entry->len > 1) {
+            struct history_entry *p;
+
+            p = history_find(entries, n, entry->str, entry->len - 1);
+            parent = (uint32_t) (p - entries) + 1;
+        }
+
+        if (!nodes[parent].n_children)
+            nodes[parent].child = (uint32_t) i + 1;
+
+        ++nodes[parent].n_children;
+
+        node->c = (uint8_t) entry->str[entry->len - 1];
+        node->target = HISTORY_NONE;
+        node->votes = entry->votes;
+
+        if (!entry->name)
+            continue;
+
+        for (uint32_t k = 0; k < n_targets; ++k) {
+            const struct history_entry *e = &entries[targets[k].offset];
+
+            if (e->name_len == entry->name_len
+                && memcmp(e->name, entry->name, entry->name_len) == 0) {
+                node->target = k;
+                break;
+            }
+        }
+
+        if (node->target == HISTORY_NONE) {
+            /* Refers to the entry until the string offsets are known */
+            targets[n_targets].offset = (uint32_t) i;
+            targets[n_targets].len = entry->name_len;
+            node->target = n_targets++;
+        }
+    }
+
+    strconcat2a(&tmp, hist->path, ".tmp");
+
+    file = fopen(tmp, "w");
+    if (!file)
+        goto out;
+
+    memcpy(header.magic, HISTORY_MAGIC, sizeof(header.magic));
+    header.n_nodes = (uint32_t) n + 1;
+    header.n_targets = n_targets;
+    header.strings_size = 0;
+    header.unused = 0;
+
+    for (uint32_t k = 0; k < n_targets; ++k)
+        header.strings_size += targets[k].len;
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(nodes, sizeof(*nodes), header.n_nodes, file);
+
+    for (uint32_t k = 0; k < n_targets; ++k) {
+        struct history_target target = {
+            .offset = size,
+            .len = targets[k].len,
+        };
+
+        fwrite(&target, sizeof(target), 1, file);
+        size += target.len;
+    }
+
+    for (uint32_t k = 0; k < n_targets; ++k)
+        fwrite(entries[targets[k].offset].name, 1, targets[k].len, file);
+
+    /* Replace the history at once, it may be in use by other instances */
+    if (fclose(file) == 0)
+        (void) rename(tmp, hist->path);
+    else
+        (void) unlink(tmp);
+
+out:
+    free(targets);
+    free(nodes);
+}
+
+void history_record(struct history *hist,
+                    const char *str,
+                    int len,
+                    const char *name,
+                    int name_len)
+{
+    struct history_entry *entries, root;
+    int n = 0;
+
+    TIMER_INIT_SIMPLE();
+
+    len = MIN(len, HISTORY_MAX_DEPTH);
+    if (len <= 0)
+        return;
+
+    entries = xmalloc((HISTORY_MAX_NODES + 1) * sizeof(*entries));
+
+    root.len = 0;
+
+    if (hist->n_nodes)
+        history_collect(hist, 0, &root, entries, &n);
+
+    qsort(entries, (size_t) n, sizeof(*entries), &history_entry_cmp);
+
+    /* Vote for the item on every prefix of the lookup string */
+    for (int i = 1; i <= len; ++i) {
+        struct history_entry *entry = history_find(entries, n, str, i);
+
+        if (!entry) {
+            if (n >= HISTORY_MAX_NODES - 1)
+                break;
+
+            entry = &entries[n++];
+
+            memcpy(entry->str, str, (size_t) i);
+            entry->len = i;
+            entry->name = NULL;
+            entry->name_len = 0;
+            entry->votes = 0;
+
+            history_vote(entry, name, (uint32_t) name_len);
+
+            qsort(entries, (size_t) n, sizeof(*entries), &history_entry_cmp);
+            continue;
+        }
+
+        history_vote(entry, name, (uint32_t) name_len);
+    }
+
+    history_write(hist, entries, n);
+
+    free(entries);
+}
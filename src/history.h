@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "item-list.h"
+
+/* Lookup strings are remembered up to this length */
+#define HISTORY_MAX_DEPTH 16
+#define HISTORY_MAX_NODES 65536
+
+/* An item needs this many more votes than others to stay remembered */
+#define HISTORY_MAX_VOTES 16
+
+#define HISTORY_NONE UINT32_MAX
+
+/*
+ * Trie node for a prefix of a lookup string. The children of a node are
+ * stored next to each other and ordered by their last character.
+ */
+struct history_node {
+    uint32_t child;
+    uint32_t target;
+    uint32_t votes;
+    uint16_t n_children;
+    uint8_t c;
+    uint8_t unused;
+};
+
+/* Name of an item chosen in the past relative to the string table */
+struct history_target {
+    uint32_t offset;
+    uint32_t len;
+};
+
+/*
+ * Items chosen for the lookup strings they were found with. Every prefix
+ * of such a lookup string has a node in a trie which remembers the item
+ * chosen most often for it, so the item for the current lookup string is
+ * found with a single step per character.
+ *
+ * The trie is stored in a file which is mapped as it is: a header, the
+ * nodes in breadth-first order, the chosen items and their names. Items
+ * are remembered by name and resolved to the items of the list while
+ * these are loaded.
+ */
+struct history {
+    char *path;
+
+    void *map;
+    size_t map_size;
+
+    const struct history_node *nodes;
+    const struct history_target *targets;
+    const char *strings;
+    uint32_t n_nodes;
+    uint32_t n_targets;
+
+    /* Item of each target and an open addressing table over their names */
+    int *items;
+    uint32_t *table;
+    uint32_t mask;
+    int n_scanned;
+};
+
+void history_init(struct history *hist);
+
+void history_destroy(struct history *hist);
+
+/* Finds the chosen items among the items added since the last call */
+void history_resolve(struct history *hist, const struct item_list *list);
+
+/* Returns the item chosen for the lookup string 'str' before or -1 */
+int history_lookup(const struct history *hist, const char *str, int len);
+
+/*
+ * Remembers that the item 'name' was chosen for the lookup string 'str'
+ * and writes the updated history to its file.
+ */
+void history_record(struct history *hist,
+                    const char *str,
+                    int len,
+                    const char *name,
+                    int name_len);
+
+#endif /* HISTORY_H_ */
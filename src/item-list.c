@@ -19,11 +19,14 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -32,34 +35,161 @@
 #include "timer.h"
 
 #include "util/env.h"
+#include "util/errstr.h"
 #include "util/io-util.h"
 #include "util/macro.h"
+#include "util/simd.h"
 #include "util/string-util.h"
 #include "util/xalloc.h"
 
-static void merge(struct item *dst,
+/* Upper bound for the amount of data read from stdin */
+#define ITEM_LIST_DATA_MAX                                                     \
+    MIN((uint64_t) UINT32_MAX + 1, (uint64_t) SIZE_MAX / 2)
+
+/* Size of a single read operation on stdin */
+#define ITEM_LIST_READ_SIZE ((size_t) 1 << 20)
+
+/* Maximum number of bytes read from stdin until control is returned */
+#define ITEM_LIST_STREAM_BUDGET ((size_t) 1 << 24)
+
+/* Input data of at least this size is parsed by an additional thread */
+#define ITEM_LIST_SPLIT_MIN ((size_t) 1 << 22)
+
+/* Maximum number of threads used for parsing input data */
+#define ITEM_LIST_SPLIT_THREADS 8
+
+/* Number of bitset words between two checks for a cancelled lookup */
+#define ITEM_LIST_CANCEL_WORDS 256
+
+/*
+ * Memory available for lookups computed ahead of time and the number of
+ * matching items sampled to predict the next character of the lookup.
+ */
+#define ITEM_LIST_SPEC_BUDGET (16 * 1024 * 1024)
+#define ITEM_LIST_SPEC_SAMPLE 4096
+
+/*
+ * Relative cost of checking an item's signature, of intersecting a word
+ * of two bitsets and of each byte compared by memmem() or fed through
+ * the lookup automaton.
+ */
+#define ITEM_LIST_COST_SIG 4
+#define ITEM_LIST_COST_WORD 2
+#define ITEM_LIST_COST_BYTE 1
+#define ITEM_LIST_COST_AC 4
+
+/* Selectivity assumed before any keystroke was observed */
+#define ITEM_LIST_PLAN_SELECTIVITY 0.5
+
+/* Weight of the latest keystroke in the selectivity estimates */
+#define ITEM_LIST_PLAN_WEIGHT 0.25
+
+/* Approximate lookups allow one typo per this many characters of a term */
+#define ITEM_LIST_APPROX_CHARS 4
+#define ITEM_LIST_APPROX_ERRORS 2
+
+/* Drops the results precomputed for likely next lookups */
+static void item_list_spec_free(struct item_list *list)
+{
+    for (int i = 0; i < ARRAY_SIZE(list->spec_sets); ++i) {
+        free(list->spec_sets[i]);
+        list->spec_sets[i] = NULL;
+    }
+
+    list->n_spec = 0;
+}
+
+/*
+ * Releases all items, their match state and the data they refer to. The
+ * lookup string and the field selection are left untouched.
+ */
+static void item_list_reset(struct item_list *list)
+{
+    if (list->map)
+        munmap((void *) list->map, list->map_size);
+
+    vmem_destroy(&list->data);
+
+    free(list->items);
+    free(list->outs);
+    free(list->sigs);
+    free(list->initials);
+    free(list->bounds);
+    free(list->parts);
+    free(list->part_bounds);
+    free(list->top);
+    free(list->offsets);
+    free(list->names);
+
+    for (int i = 0; i < ARRAY_SIZE(list->index); ++i) {
+        free(list->index[i]);
+        list->index[i] = NULL;
+    }
+    free(list->mem);
+
+    for (int i = 0; i < ARRAY_SIZE(list->matches); ++i) {
+        free(list->matches[i]);
+
+        list->matches[i] = NULL;
+        list->counts[i] = 0;
+    }
+
+    item_list_spec_free(list);
+
+    list->base = NULL;
+    list->items = NULL;
+    list->outs = NULL;
+    list->sigs = NULL;
+    list->initials = NULL;
+    list->bounds = NULL;
+    list->initials_len = 0;
+    list->initials_max = 0;
+    list->parts = NULL;
+    list->part_bounds = NULL;
+    list->parts_len = 0;
+    list->parts_max = 0;
+    list->top = NULL;
+    list->n_top = 0;
+    list->top_valid = false;
+    list->text_len = 0;
+    list->offsets = NULL;
+    list->offsets_len = -1;
+    list->names = NULL;
+    list->mem = NULL;
+    list->map = NULL;
+    list->map_size = 0;
+    list->data_len = 0;
+    list->data_line = 0;
+    list->n = 0;
+    list->n_max = 0;
+    list->match_max = 0;
+}
+
+static void merge(const char *base,
+                  struct item *dst,
                   struct item *s1,
                   const struct item *e1,
                   struct item *s2,
                   const struct item *e2)
 {
     while (s1 < e1 && s2 < e2) {
-        if (strverscmp(s1->name, s2->name) <= 0)
-            dst++->name = s1++->name;
+        if (strverscmp(base + s1->offset, base + s2->offset) <= 0)
+            *dst++ = *s1++;
         else
-            dst++->name = s2++->name;
+            *dst++ = *s2++;
     }
 
     while (s1 < e1)
-        dst++->name = s1++->name;
+        *dst++ = *s1++;
 
     while (s2 < e2)
-        dst++->name = s2++->name;
+        *dst++ = *s2++;
 }
 
 static void item_list_sort(struct item_list *list)
 {
     struct item *buf, *items = list->items;
+    const char *base = list->base;
     int n = 16, size = list->n;
     bool use_heap;
 
@@ -77,15 +207,16 @@ static void item_list_sort(struct item_list *list)
             end = size;
 
         for (int j = i + 1; j < end; ++j) {
-            char *name = items[j].name;
+            struct item item = items[j];
             int k = j;
 
-            while (k > i && strverscmp(items[k - 1].name, name) > 0) {
-                items[k].name = items[k - 1].name;
+            while (k > i && strverscmp(base + items[k - 1].offset,
+                                       base + item.offset) > 0) {
+                items[k] = items[k - 1];
                 --k;
             }
 
-            items[k].name = name;
+            items[k] = item;
         }
     }
 
@@ -107,7 +238,7 @@ static void item_list_sort(struct item_list *list)
             if (k > size)
                 k = size;
 
-            merge(dst, src + i, src + j, src + j, src + k);
+            merge(base, dst, src + i, src + j, src + j, src + k);
             dst += k - i;
         }
 
@@ -126,7 +257,7 @@ static void item_list_sort(struct item_list *list)
             if (k > size)
                 k = size;
 
-            merge(dst, src + i, src + j, src + j, src + k);
+            merge(base, dst, src + i, src + j, src + j, src + k);
             dst += k - i;
         }
 
@@ -141,34 +272,352 @@ static void item_list_sort(struct item_list *list)
 
 static void item_list_dedup(struct item_list *list)
 {
+    const char *base = list->base;
     int i = 0;
 
     for (int j = 1; j < list->n; ++j) {
-        if (strcmp(list->items[i].name, list->items[j].name) != 0) {
-            list->items[++i].name = list->items[j].name;
-            continue;
-        }
+        const struct item *a = list->items + i, *b = list->items + j;
 
-#ifdef MEM_NOLEAK
-        free(list->items[j].name);
-#endif
+        if (a->len != b->len ||
+            memcmp(base + a->offset, base + b->offset, a->len) != 0)
+            list->items[++i] = list->items[j];
     }
 
     /* Last index containing a unique item is 'i' */
     list->n = i + 1;
 }
 
+struct item_list_split {
+    const char *base;
+    const char *begin;
+    const char *end;
+    bool words;
+    const struct item_fields *fields;
+
+    struct item *items;
+    struct item *outs;
+    size_t n;
+    size_t n_max;
+
+    pthread_t thread;
+    bool joinable;
+};
+
+/*
+ * Narrows [*str, *end) down to the fields 'first' to 'last' separated
+ * by 'delim'. Returns false if the line does not contain field 'first'.
+ */
+static bool item_list_field_select(const char **str,
+                                   const char **end,
+                                   int delim,
+                                   int first,
+                                   int last)
+{
+    const char *p = *str, *q;
+
+    for (int i = 1; i < first; ++i) {
+        p = memchr(p, delim, *end - p);
+        if (!p)
+            return false;
+
+        ++p;
+    }
+
+    *str = p;
+
+    if (!last)
+        return true;
+
+    for (int i = first; i < last && p; ++i) {
+        p = memchr(p, delim, *end - p);
+        if (p)
+            ++p;
+    }
+
+    if (p) {
+        q = memchr(p, delim, *end - p);
+        if (q)
+            *end = q;
+    }
+
+    return true;
+}
+
+static void item_list_split_push(struct item_list_split *split,
+                                 const char *str,
+                                 const char *end)
+{
+    const char *out = str, *out_end = end;
+    size_t n = split->n;
+
+    if (split->fields) {
+        const struct item_fields *fields = split->fields;
+
+        /* Lines missing the selected fields are not usable as items */
+        if (!item_list_field_select(&out,
+                                    &out_end,
+                                    fields->delim,
+                                    fields->out_first,
+                                    fields->out_last))
+            return;
+
+        if (!item_list_field_select(&str,
+                                    &end,
+                                    fields->delim,
+                                    fields->with_first,
+                                    fields->with_last))
+            return;
+
+        if (str == end || out == out_end)
+            return;
+    }
+
+    /* Grows from any capacity, the list may start out without items */
+    if (n >= split->n_max) {
+        split->n_max += split->n_max / 2 + 16;
+
+        split->items =
+            xrealloc(split->items, split->n_max * sizeof(*split->items));
+
+        if (split->fields)
+            split->outs =
+                xrealloc(split->outs, split->n_max * sizeof(*split->outs));
+    }
+
+    split->items[n].offset = (uint32_t) (str - split->base);
+    split->items[n].len = (uint32_t) (end - str);
+
+    if (split->fields) {
+        split->outs[n].offset = (uint32_t) (out - split->base);
+        split->outs[n].len = (uint32_t) (out_end - out);
+    }
+
+    split->n = n + 1;
+}
+
+static void item_list_split_run(struct item_list_split *split)
+{
+    const char *data = split->begin;
+    size_t size = split->end - split->begin;
+    const char *str = NULL;
+    bool skip = false;
+
+    /*
+     * The data is processed in blocks of 64 bytes. For each block, bit masks
+     * for newline and whitespace characters are computed at once. Lines
+     * and words are then extracted by scanning these masks instead of
+     * looking at every single byte.
+     */
+    for (size_t i = 0; i < size; i += 64) {
+        const char *p = data + i;
+        uint64_t nl, ws, bits, mask = ~0ull;
+        char buf[64];
+
+        /* Pad the last block with newlines to terminate the last line */
+        if (size - i < sizeof(buf)) {
+            memset(buf, '\n', sizeof(buf));
+            memcpy(buf, p, size - i);
+
+            simd_classify64(buf, &nl, &ws);
+        } else {
+            simd_classify64(p, &nl, &ws);
+        }
+
+        if (!split->words) {
+            if (!str)
+                str = p;
+
+            /* Each non-empty line is an item */
+            for (bits = nl; bits; bits &= bits - 1) {
+                const char *eol = p + __builtin_ctzll(bits);
+
+                if (str < eol)
+                    item_list_split_push(split, str, eol);
+
+                str = eol + 1;
+            }
+
+            continue;
+        }
+
+        /* Only the first word of each line is an item */
+        while (1) {
+            int j;
+
+            if (skip) {
+                bits = nl & mask;
+                if (!bits)
+                    break;
+
+                j = __builtin_ctzll(bits);
+                mask &= ~((2ull << j) - 1);
+                skip = false;
+            }
+
+            if (!str) {
+                bits = ~ws & mask;
+                if (!bits)
+                    break;
+
+                j = __builtin_ctzll(bits);
+                mask &= ~((1ull << j) - 1);
+                str = p + j;
+            }
+
+            bits = ws & mask;
+            if (!bits)
+                break;
+
+            j = __builtin_ctzll(bits);
+            mask &= ~((2ull << j) - 1);
+
+            item_list_split_push(split, str, p + j);
+
+            str = NULL;
+            skip = !(nl & (1ull << j));
+        }
+    }
+
+    /* Without padding, an unterminated last line is still pending */
+    if (str && str < data + size && !skip)
+        item_list_split_push(split, str, data + size);
+}
+
+static void *item_list_split_thread(void *arg)
+{
+    item_list_split_run(arg);
+
+    return NULL;
+}
+
+static void item_list_add_data(struct item_list *list,
+                               const char *data,
+                               const char *end,
+                               bool words)
+{
+    struct item_list_split splits[ITEM_LIST_SPLIT_THREADS];
+    size_t size, n;
+    long n_cpus;
+    int n_splits;
+
+    TIMER_INIT_SIMPLE();
+
+    size = end - data;
+
+    n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n_cpus = MAX(n_cpus, 1);
+
+    n_splits = (int) MIN(size / ITEM_LIST_SPLIT_MIN + 1, (size_t) n_cpus);
+    n_splits = MIN(n_splits, ITEM_LIST_SPLIT_THREADS);
+
+    /*
+     * Large inputs are split up into chunks of complete lines which
+     * are parsed in parallel. The first chunk appends directly to the
+     * item list, all others are appended once they are done.
+     */
+    for (int i = 0; i < n_splits; ++i) {
+        struct item_list_split *split = splits + i;
+
+        split->begin = (i) ? splits[i - 1].end : data;
+        split->end = end;
+
+        if (i < n_splits - 1) {
+            const char *p = data + size / n_splits * (i + 1);
+
+            p = memchr(MAX(p, split->begin), '\n', end - MAX(p, split->begin));
+            if (p)
+                split->end = p + 1;
+        }
+
+        split->base = list->base;
+        split->words = words;
+        split->fields = list->fields;
+        split->joinable = false;
+
+        if (!i) {
+            split->items = list->items;
+            split->outs = list->outs;
+            split->n = list->n;
+            /* Only the capacity actually allocated, e.g. for the cache */
+            split->n_max = list->n_max;
+
+            if (split->fields)
+                split->outs = xrealloc(split->outs,
+                                       split->n_max * sizeof(*split->outs));
+
+            continue;
+        }
+
+        /* Get a good initial value for the number of expected items */
+        split->n = 0;
+        split->n_max = (split->end - split->begin) / 40 + 16;
+        split->items = xmalloc(split->n_max * sizeof(*split->items));
+        split->outs = NULL;
+
+        if (split->fields)
+            split->outs = xmalloc(split->n_max * sizeof(*split->outs));
+
+        split->joinable = !pthread_create(&split->thread,
+                                          NULL,
+                                          &item_list_split_thread,
+                                          split);
+        if (!split->joinable)
+            item_list_split_run(split);
+    }
+
+    item_list_split_run(splits);
+
+    n = splits[0].n;
+
+    for (int i = 1; i < n_splits; ++i) {
+        if (splits[i].joinable)
+            (void) pthread_join(splits[i].thread, NULL);
+
+        n += splits[i].n;
+    }
+
+    if (n > splits[0].n_max) {
+        splits[0].n_max = n;
+        splits[0].items =
+            xrealloc(splits[0].items, n * sizeof(*splits[0].items));
+
+        if (splits[0].fields)
+            splits[0].outs =
+                xrealloc(splits[0].outs, n * sizeof(*splits[0].outs));
+    }
+
+    n = splits[0].n;
+
+    for (int i = 1; i < n_splits; ++i) {
+        size = splits[i].n * sizeof(*splits[i].items);
+
+        memcpy(splits[0].items + n, splits[i].items, size);
+
+        if (splits[i].fields)
+            memcpy(splits[0].outs + n, splits[i].outs, size);
+
+        n += splits[i].n;
+
+        free(splits[i].items);
+        free(splits[i].outs);
+    }
+
+    list->items = splits[0].items;
+    list->outs = splits[0].outs;
+    list->n = (int) n;
+    list->n_max = (int) splits[0].n_max;
+}
+
 static int
 item_list_do_cache_read(struct item_list *list, int fd, const char *dirs)
 {
-    struct item *items;
     char *ptr, *str;
-    size_t n = 0, n_max;
+    size_t size, n_max;
     int err;
 
     free(list->mem);
 
-    err = io_util_read_all_str(fd, (char **) &list->mem, NULL);
+    err = io_util_read_all_str(fd, (char **) &list->mem, &size);
     if (err < 0)
         return -1;
 
@@ -191,40 +640,22 @@ item_list_do_cache_read(struct item_list *list, int fd, const char *dirs)
         return -1;
 
     n_max = strtoul(ptr, &ptr, 10);
+    if (n_max > INT_MAX || size > ITEM_LIST_DATA_MAX)
+        return -1;
 
     /* Retrieve all items from the cache */
-    items = xmalloc(n_max * sizeof(*items));
-
-    while (ptr) {
-        str = ptr;
-        ptr = strchr(ptr, '\n');
-
-        /* Convert the newline to a terminating null byte */
-        if (ptr)
-            *ptr++ = '\0';
-
-        /*
-         * If at the beginning of this iteration 'ptr' pointed to a newline
-         * character or the end of the string itself, then 'str' will be empty
-         * and can therefore be skipped.
-         */
-        if (*str == '\0')
-            continue;
-
-        if (n >= n_max)
-            return -1;
+    list->base = list->mem;
+    list->items = xmalloc(n_max * sizeof(*list->items));
+    list->n = 0;
+    list->n_max = n_max;
 
-        items[n].name = str;
-        items[n].score = 0;
+    item_list_add_data(list, ptr, (char *) list->mem + size, false);
 
-        ++n;
+    if ((size_t) list->n > n_max) {
+        item_list_reset(list);
+        return -1;
     }
 
-    /* Move data to app list structure */
-    list->items = items;
-    list->n = n;
-    list->n_max = n_max;
-
     return 0;
 }
 
@@ -315,7 +746,7 @@ static void item_list_write_cache(const struct item_list *list,
     fprintf(file, "%s\n%d\n\n", dirs, list->n);
 
     for (int i = 0; i < list->n; ++i)
-        fprintf(file, "%s\n", list->items[i].name);
+        fprintf(file, "%s\n", list->base + list->items[i].offset);
 
     fclose(file);
 }
@@ -325,7 +756,8 @@ item_list_do_load(struct item_list *list, const char *cache, char *dirs)
 {
     struct item *items;
     size_t n = 0, n_max = 4096;
-    char *it;
+    size_t len = 0, len_max = 65536;
+    char *names, *it;
     int err;
 
     /* Check if we can use previously cached data */
@@ -334,6 +766,7 @@ item_list_do_load(struct item_list *list, const char *cache, char *dirs)
         return;
 
     items = xmalloc(n_max * sizeof(*items));
+    names = xmalloc(len_max);
 
     /*
      * Iterate over all directories in 'dirs' and search for executable
@@ -365,6 +798,7 @@ item_list_do_load(struct item_list *list, const char *cache, char *dirs)
         while (1) {
             struct dirent *entry = readdir(dir);
             struct stat st;
+            size_t size;
 
             if (!entry)
                 break;
@@ -382,9 +816,21 @@ item_list_do_load(struct item_list *list, const char *cache, char *dirs)
                 items = xrealloc(items, n_max * sizeof(*items));
             }
 
-            items[n].name = xstrdup(entry->d_name);
-            items[n].score = 0;
+            /* Names are kept null terminated for sorting */
+            size = strlen(entry->d_name) + 1;
+
+            if (len + size > len_max) {
+                len_max = len_max * 2 + size;
+
+                names = xrealloc(names, len_max);
+            }
+
+            memcpy(names + len, entry->d_name, size);
+
+            items[n].offset = (uint32_t) len;
+            items[n].len = (uint32_t) size - 1;
 
+            len += size;
             ++n;
         }
 
@@ -392,6 +838,8 @@ item_list_do_load(struct item_list *list, const char *cache, char *dirs)
     }
 
     /* Move data to app list structure */
+    list->base = names;
+    list->names = names;
     list->items = items;
     list->n = n;
     list->n_max = n_max;
@@ -402,99 +850,6 @@ item_list_do_load(struct item_list *list, const char *cache, char *dirs)
     item_list_write_cache(list, cache, dirs);
 }
 
-static void item_list_load_from_stdin(struct item_list *list)
-{
-    size_t n = 0, n_max = 4096;
-    struct item *items;
-    char *data;
-
-    data = xmalloc(n_max);
-
-    /* Read all available data from stdin */
-    while (1) {
-        ssize_t m = read(STDIN_FILENO, data + n, n_max - n);
-        if (m < 0) {
-            if (errno == EINTR)
-                continue;
-
-            die("failed to read data from stdin\n");
-        }
-
-        if (!m)
-            break;
-
-        n += m;
-
-        if (n >= n_max) {
-            n_max *= 2;
-
-            data = xrealloc(data, n_max);
-        }
-    }
-
-    if (!n) {
-        /* No data available */
-        free(data);
-        return;
-    }
-
-    /* Ensure that we can treat the data as a string */
-    if (n >= n_max)
-        data = xrealloc(data, n_max + 1);
-
-    data[n] = '\0';
-
-    /* Get a good initial value for the number of expected items */
-    n_max = n / 40 + 10;
-    n = 0;
-
-    items = xmalloc(n_max * sizeof(*items));
-
-    /* Extract the names from the data and move them into an array */
-    while (data) {
-        char *p, *str = data;
-
-        data = strchr(data, '\n');
-        if (data)
-            *data++ = '\0';
-
-        /* Trim preceding spaces */
-        while (*str != '\0' && isspace(*str))
-            ++str;
-
-        p = str;
-
-        /* Trim trailing spaces */
-        while (*p != '\0' && !isspace(*p))
-            ++p;
-
-        *p = '\0';
-
-        /* Skip empty strings */
-        if (str == p)
-            continue;
-
-        if (n >= n_max) {
-            n_max = n_max * 2 - n_max / 2;
-
-            items = xrealloc(items, n_max * sizeof(*items));
-        }
-
-        items[n].name = str;
-        items[n].score = 0;
-
-        ++n;
-    }
-
-    /* Move data to app list structure */
-    list->items = items;
-    list->n = n;
-    list->n_max = n_max;
-
-    free(list->mem);
-    list->mem = data;
-}
-
 static void item_list_load_from_directories(struct item_list *list,
                                             const char *dirs)
 {
@@ -520,91 +875,1530 @@ static void item_list_load_from_directories(struct item_list *list,
     item_list_do_load(list, cache, dup);
 }
 
-void item_list_init(struct item_list *list, const char *dirs)
+/*
+ * Maps a character to one of 64 buckets: digits, lower and upper case
+ * letters get a bucket of their own while all other characters share
+ * the remaining two.
+ */
+static inline uint64_t item_list_sig_bit(unsigned char c)
 {
-    TIMER_INIT_SIMPLE();
+    if (c >= '0' && c <= '9')
+        return (uint64_t) 1 << (c - '0');
 
-    memset(list, 0, sizeof(*list));
-
-    if (!dirs) {
-        int n_packets, n_bytes;
+    if (c >= 'a' && c <= 'z')
+        return (uint64_t) 1 << (10 + c - 'a');
 
-        n_packets = ioctl(STDIN_FILENO, FIONREAD, &n_bytes);
-        if (unlikely(n_packets < 0))
-            die("failed to check for data on stdin\n");
+    if (c >= 'A' && c <= 'Z')
+        return (uint64_t) 1 << (36 + c - 'A');
 
-        if (n_bytes > 0) {
-            item_list_load_from_stdin(list);
+    return (uint64_t) 1 << (62 + (c & 0x01));
+}
 
-            if (!item_list_empty(list))
-                return;
-        }
+static uint64_t item_list_sig(const char *str, size_t len)
+{
+    uint64_t sig = 0;
 
-        /*
-         * No directory paths passed and nothing to read from stdin.
-         * Use default.
-         */
-        dirs = getenv("PATH");
-        if (unlikely(!dirs))
-            die("failed to retrieve ${PATH} variable from environment\n");
-    }
+    for (size_t i = 0; i < len; ++i)
+        sig |= item_list_sig_bit((unsigned char) str[i]);
 
-    item_list_load_from_directories(list, dirs);
+    return sig;
 }
 
-void item_list_destroy(struct item_list *list)
+/*
+ * Returns the signature of the first 'len' characters of the lookup
+ * string without the spaces separating its terms.
+ */
+static uint64_t item_list_lookup_sig(const struct item_list *list, int len)
 {
-#ifdef MEM_NOLEAK
-    if (!list->mem) {
-        for (int i = 0; i < list->n; ++i)
-            free(list->items[i].name);
+    uint64_t sig = 0;
+
+    /* Initials are lower case, so they cannot be checked against it */
+    if (list->mode == APP_LIST_SEARCH_ACRONYM)
+        return 0;
+
+    for (int i = 0; i < len; ++i) {
+        if (list->lookup[i] != ' ')
+            sig |= item_list_sig_bit((unsigned char) list->lookup[i]);
     }
 
-    free(list->items);
-    free(list->mem);
-#else
-    (void) list;
-#endif
+    return sig;
 }
 
-void item_list_lookup_clear(struct item_list *list)
+/*
+ * Returns true if a word starts at 'str[i]', i.e. after a separator, at
+ * a transition from lower to upper case or between letters and digits.
+ */
+static bool item_list_word_start(const char *str, size_t i)
 {
-    /* Clear lookup string */
-    while (list->strlen)
-        list->lookup[list->strlen--] = '\0';
+    unsigned char c = (unsigned char) str[i], prev;
 
-    /* Clear item list */
-    for (int i = 0; i < list->n; ++i)
-        list->items[i].score = 0;
-}
+    if (!isalnum(c))
+        return false;
+
+    if (!i)
+        return true;
+
+    prev = (unsigned char) str[i - 1];
+
+    if (!isalnum(prev) || (islower(prev) && isupper(c)))
+        return true;
+
+    return !isdigit(prev) != !isdigit(c);
+}
+
+static void item_list_add_initials(struct item_list *list, int index)
+{
+    const char *name = item_list_name(list, index);
+    size_t len = item_list_name_len(list, index);
+
+    /* Reserve enough space for a name consisting of single letter words */
+    if (list->initials_len + len > list->initials_max) {
+        list->initials_max = MAX(2 * list->initials_max,
+                                 list->initials_len + len);
+        list->initials = xrealloc(list->initials, list->initials_max);
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        if (item_list_word_start(name, i))
+            list->initials[list->initials_len++] = (char) tolower(name[i]);
+    }
+
+    list->bounds[index + 1] = (uint32_t) list->initials_len;
+}
+
+/*
+ * Returns false for the modes in which the items matching a lookup
+ * string are not necessarily a subset of those matching its prefixes.
+ */
+static inline bool item_list_narrowable(const struct item_list *list)
+{
+    return list->mode != APP_LIST_SEARCH_REGEX
+           && list->mode != APP_LIST_SEARCH_APPROX;
+}
+
+static void item_list_add_parts(struct item_list *list, int index)
+{
+    const char *name = item_list_name(list, index);
+    size_t len = MIN((size_t) item_list_name_len(list, index), UINT16_MAX);
+    const char *end = name + len, *ptr = name;
+
+    while ((ptr = memchr(ptr, '/', (size_t) (end - ptr)))) {
+        if (list->parts_len >= list->parts_max) {
+            list->parts_max = MAX(2 * list->parts_max, 4096);
+            list->parts = xrealloc(list->parts,
+                                   list->parts_max * sizeof(*list->parts));
+        }
+
+        list->parts[list->parts_len++] = (uint16_t) (ptr - name);
+        ++ptr;
+    }
+
+    list->part_bounds[index + 1] = (uint32_t) list->parts_len;
+}
+
+/*
+ * Returns the string the lookup string is matched against, which is
+ * either the item's name or its initials in acronym mode.
+ */
+static const char *
+item_list_text(const struct item_list *list, int index, size_t *len)
+{
+    if (list->mode == APP_LIST_SEARCH_ACRONYM) {
+        *len = list->bounds[index + 1] - list->bounds[index];
+        return list->initials + list->bounds[index];
+    }
+
+    *len = item_list_name_len(list, index);
+    return item_list_name(list, index);
+}
+
+/* Initials are lower case, so acronyms are looked up case insensitively */
+static const char *item_list_term(const struct item_list *list,
+                                  const char *term,
+                                  size_t len,
+                                  char *buf)
+{
+    if (list->mode != APP_LIST_SEARCH_ACRONYM)
+        return term;
+
+    for (size_t i = 0; i < len; ++i)
+        buf[i] = (char) tolower(term[i]);
+
+    return buf;
+}
+
+/* Returns the offset of the last component of an item's path */
+static size_t item_list_basename(const struct item_list *list, int index)
+{
+    uint32_t end = list->part_bounds[index + 1];
+
+    if (end == list->part_bounds[index])
+        return 0;
+
+    return (size_t) list->parts[end - 1] + 1;
+}
+
+/*
+ * Returns the offset of the first occurrence of 'term' in the item at or
+ * after 'from', or -1 if there is none. In path mode, terms without a
+ * slash have to be contained in a single path component.
+ */
+static long item_list_find(const struct item_list *list,
+                           int index,
+                           const char *term,
+                           size_t size,
+                           size_t from)
+{
+    const char *name = item_list_name(list, index), *pos;
+    size_t len = item_list_name_len(list, index), begin = 0;
+
+    if (list->mode != APP_LIST_SEARCH_PATH || memchr(term, '/', size)) {
+        name = item_list_text(list, index, &len);
+
+        if (from > len)
+            return -1;
+
+        pos = memmem(name + from, len - from, term, size);
+
+        return (pos) ? pos - name : -1;
+    }
+
+    for (uint32_t i = list->part_bounds[index];
+         i <= list->part_bounds[index + 1];
+         ++i) {
+        size_t end = len;
+
+        if (i < list->part_bounds[index + 1])
+            end = list->parts[i];
+
+        begin = MAX(begin, from);
+
+        if (begin <= end) {
+            pos = memmem(name + begin, end - begin, term, size);
+            if (pos)
+                return pos - name;
+        }
+
+        begin = end + 1;
+    }
+
+    return -1;
+}
+
+/*
+ * Returns the states of the lookup automaton found within the single
+ * path components of the item.
+ */
+static uint64_t item_list_scan_parts(const struct item_list *list, int index)
+{
+    const char *name = item_list_name(list, index);
+    size_t len = item_list_name_len(list, index), begin = 0;
+    uint64_t seen = 0;
+
+    for (uint32_t i = list->part_bounds[index];
+         i <= list->part_bounds[index + 1];
+         ++i) {
+        size_t end = len;
+
+        if (i < list->part_bounds[index + 1])
+            end = list->parts[i];
+
+        seen |= aho_corasick_scan(&list->ac, name + begin, end - begin);
+        begin = end + 1;
+    }
+
+    return seen;
+}
+
+static void item_list_build_ac(struct item_list *list)
+{
+    char buf[ARRAY_SIZE(list->lookup)];
+    int i = 0;
+
+    aho_corasick_init(&list->ac);
+
+    while (i < list->strlen) {
+        const char *term = list->lookup + i;
+        int len = 0;
+
+        while (i + len < list->strlen && list->lookup[i + len] != ' ')
+            ++len;
+
+        term = item_list_term(list, term, (size_t) len, buf);
+
+        /* There are never more characters than available states */
+        (void) aho_corasick_add(&list->ac, term, len, list->ac_states + i);
+
+        i += len + 1;
+    }
+
+    aho_corasick_build(&list->ac);
+
+    list->ac_valid = true;
+}
+
+/*
+ * Returns true if the lookup string matches the item in one of the modes
+ * which check all items after every change of the lookup string.
+ */
+static bool item_list_rescan_match(struct item_list *list, int index)
+{
+    const char *name = item_list_name(list, index);
+    size_t len = item_list_name_len(list, index);
+
+    if (list->mode == APP_LIST_SEARCH_REGEX)
+        return dfa_match(&list->dfa, name, len);
+
+    for (int i = 0; i < list->n_terms; ++i) {
+        const struct item_term *term = &list->terms[i];
+
+        /*
+         * Each character the name is shorter than the term and each
+         * character bucket of the term missing from the name takes an
+         * edit of its own.
+         */
+        if (len + (size_t) term->k < (size_t) term->len)
+            return false;
+
+        if (__builtin_popcountll(term->sig & ~list->sigs[index]) > term->k)
+            return false;
+
+        if (!term->k && !memmem(name, len, term->str, (size_t) term->len))
+            return false;
+
+        if (term->k && !myers_match(&term->myers, name, len, term->k))
+            return false;
+    }
+
+    return true;
+}
+
+static int item_list_match_depth(struct item_list *list, int index)
+{
+    const char *name;
+    size_t len;
+    uint64_t seen, parts;
+    bool slash = false;
+
+    if (!list->strlen)
+        return 0;
+
+    name = item_list_text(list, index, &len);
+
+    if (!item_list_narrowable(list))
+        return item_list_rescan_match(list, index) ? list->strlen : 0;
+
+    /*
+     * Find the longest prefix of the lookup string whose terms are all
+     * contained in the item's name. This is the depth the item would
+     * have reached if it had been present while the lookup string was
+     * typed in. All terms are searched for in a single pass.
+     */
+    seen = aho_corasick_scan(&list->ac, name, len);
+    parts = seen;
+
+    /* Until a term contains a slash, it has to be found in one component */
+    if (list->mode == APP_LIST_SEARCH_PATH)
+        parts = item_list_scan_parts(list, index);
+
+    for (int i = 0; i < list->strlen; ++i) {
+        uint64_t states;
+
+        if (list->lookup[i] == ' ') {
+            slash = false;
+            continue;
+        }
+
+        slash = slash || list->lookup[i] == '/';
+        states = (slash) ? seen : parts;
+
+        if (!(states & ((uint64_t) 1 << list->ac_states[i])))
+            return i;
+    }
+
+    return list->strlen;
+}
+
+static uint64_t *item_list_match_set(struct item_list *list, int depth)
+{
+    size_t size;
+
+    if (!list->matches[depth]) {
+        size = bitset_words((size_t) list->match_max) * sizeof(uint64_t);
+
+        list->matches[depth] = xcalloc(1, size);
+    }
+
+    return list->matches[depth];
+}
+
+static void item_list_lookup_apply(struct item_list *list, int begin, int end)
+{
+    /* Bitsets grow along with the item array and are zeroed at the tail */
+    if (list->match_max < list->n_max || !list->matches[0]) {
+        size_t n_words = bitset_words((size_t) list->match_max);
+        size_t size;
+
+        list->match_max = MAX(list->n_max, 64);
+        size = bitset_words((size_t) list->match_max) * sizeof(uint64_t);
+
+        for (int i = 0; i < ARRAY_SIZE(list->matches); ++i) {
+            uint64_t *set = list->matches[i];
+
+            if (!set)
+                continue;
+
+            set = xrealloc(set, size);
+            memset(set + n_words, 0, size - n_words * sizeof(*set));
+
+            list->matches[i] = set;
+        }
+
+        size = list->match_max * sizeof(*list->sigs);
+        list->sigs = xrealloc(list->sigs, size);
+
+        size = list->match_max * sizeof(*list->offsets);
+        list->offsets = xrealloc(list->offsets, size);
+
+        size = bitset_words((size_t) list->match_max) * sizeof(uint64_t);
+
+        for (int i = 0; i < ARRAY_SIZE(list->index); ++i) {
+            uint64_t *set = xrealloc(list->index[i], size);
+
+            memset(set + n_words, 0, size - n_words * sizeof(*set));
+            list->index[i] = set;
+        }
+
+        size = (list->match_max + 1) * sizeof(*list->bounds);
+        list->bounds = xrealloc(list->bounds, size);
+        list->bounds[0] = 0;
+
+        size = (list->match_max + 1) * sizeof(*list->part_bounds);
+        list->part_bounds = xrealloc(list->part_bounds, size);
+        list->part_bounds[0] = 0;
+
+        /* Allocated again with the new size when needed */
+        free(list->top);
+        list->top = NULL;
+
+        /* Bitsets are swapped with these, so they must not be smaller */
+        item_list_spec_free(list);
+    }
+
+    /* New items are missing from the bitsets computed ahead of time */
+    list->n_spec = 0;
+    list->top_valid = false;
+    list->offsets_len = -1;
+
+    for (int i = 0; i <= list->strlen; ++i)
+        (void) item_list_match_set(list, i);
+
+    if (!list->ac_valid)
+        item_list_build_ac(list);
+
+    list->initials_len = list->bounds[begin];
+    list->parts_len = list->part_bounds[begin];
+
+    for (int i = begin; i < end; ++i) {
+        const char *name = item_list_name(list, i);
+        int depth, len = item_list_name_len(list, i);
+
+        list->sigs[i] = item_list_sig(name, len);
+        list->text_len += (size_t) len;
+
+        for (uint64_t sig = list->sigs[i]; sig; sig &= sig - 1)
+            bitset_set(list->index[__builtin_ctzll(sig)], (size_t) i);
+
+        item_list_add_initials(list, i);
+        item_list_add_parts(list, i);
+
+        depth = item_list_match_depth(list, i);
+
+        for (int j = 0; j <= depth; ++j) {
+            bitset_set(list->matches[j], (size_t) i);
+            ++list->counts[j];
+        }
+    }
+}
+
+static void item_list_map(struct item_list *list, int fd, size_t size)
+{
+    const int flags = MAP_PRIVATE | MAP_POPULATE;
+    char *map;
 
-void item_list_lookup_push_back(struct item_list *list, int c)
-{
     TIMER_INIT_SIMPLE();
 
-    if (list->strlen < ARRAY_SIZE(list->lookup) - 1 && isascii(c))
-        list->lookup[list->strlen++] = (char) c;
+    /* Items refer to their names with 32 bit offsets */
+    if (unlikely(size > ITEM_LIST_DATA_MAX))
+        die("input exceeds the maximum size of %zu bytes\n",
+            (size_t) ITEM_LIST_DATA_MAX);
+
+    /*
+     * All of the file is going to be parsed right away, so let the
+     * kernel read it in one go instead of faulting in page by page.
+     */
+    map = mmap(NULL, size, PROT_READ, flags, fd, 0);
+    if (unlikely(map == MAP_FAILED))
+        die("failed to memory map input data: %s\n", errstr(errno));
+
+    list->base = map;
+    list->map = map;
+    list->map_size = size;
+
+    /* Get a good initial value for the number of expected items */
+    list->n_max = size / 40 + 10;
+    list->items = xmalloc(list->n_max * sizeof(*list->items));
+
+    item_list_add_data(list, map, map + size, !list->fields);
+}
+
+static void item_list_stream_init(struct item_list *list, int fd)
+{
+    int err;
+
+    err = vmem_init(&list->data, ITEM_LIST_DATA_MAX);
+    if (unlikely(err < 0))
+        die("failed to reserve memory for the input data: %s\n", errstr(-err));
+
+    list->base = list->data.base;
+    list->n_max = 4096;
+    list->items = xmalloc(list->n_max * sizeof(*list->items));
+    list->fd = fd;
+}
+
+static void item_list_stream_parse(struct item_list *list, bool eof)
+{
+    const char *begin, *end;
+
+    begin = list->data.base + list->data_line;
+    end = list->data.base + list->data_len;
+
+    /* Incomplete lines are kept until the rest of the line is available */
+    if (!eof) {
+        end = memrchr(begin, '\n', end - begin);
+        if (!end)
+            return;
+
+        ++end;
+    }
+
+    item_list_add_data(list, begin, end, !list->fields);
+
+    list->data_line = end - list->data.base;
+}
+
+int item_list_stream_read(struct item_list *list)
+{
+    size_t n = 0;
+    int n_items = list->n;
+    bool eof = false;
+
+    TIMER_INIT_SIMPLE();
+
+    if (list->fd < 0)
+        return 0;
+
+    /*
+     * Read what is currently available but return to the caller from time
+     * to time, so that a fast producer cannot starve the user interface.
+     */
+    while (n < ITEM_LIST_STREAM_BUDGET) {
+        size_t size;
+        ssize_t m;
+        int err;
+
+        size = MIN(ITEM_LIST_READ_SIZE, list->data.max - list->data_len);
+        if (unlikely(!size))
+            die("input exceeds the maximum size of %zu bytes\n",
+                list->data.max);
+
+        err = vmem_grow(&list->data, list->data_len + size);
+        if (unlikely(err < 0))
+            die("failed to allocate memory for input data: %s\n", errstr(-err));
+
+        m = read(list->fd, list->data.base + list->data_len, size);
+        if (m < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            die("failed to read input data: %s\n", errstr(errno));
+        }
+
+        if (!m) {
+            eof = true;
+            break;
+        }
+
+        list->data_len += m;
+        n += m;
+    }
+
+    item_list_stream_parse(list, eof);
+    item_list_lookup_apply(list, n_items, list->n);
+
+    if (!eof)
+        return list->n - n_items;
+
+    list->fd = -1;
+
+    if (item_list_empty(list) && list->fallback) {
+        const char *dirs;
+
+        /*
+         * Standard input did not provide any items. Behave as if there
+         * was nothing to read from it in the first place.
+         */
+        dirs = getenv("PATH");
+        if (unlikely(!dirs))
+            die("failed to retrieve ${PATH} variable from environment\n");
+
+        item_list_reset(list);
+        list->fields = NULL;
+
+        item_list_load_from_directories(list, dirs);
+        item_list_lookup_apply(list, 0, list->n);
+    }
+
+    return list->n - n_items;
+}
+
+static int item_list_load_fd(struct item_list *list, int fd)
+{
+    struct stat st;
+    int err;
+
+    err = fstat(fd, &st);
+    if (unlikely(err < 0))
+        die("failed to check for input data: %s\n", errstr(errno));
+
+    /*
+     * Data from pipes may arrive at any time, e.g. if the producer is
+     * slow. Instead of waiting for all of it, items are appended
+     * by the event loop whenever new data is available.
+     */
+    if (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)) {
+        int flags;
+
+        item_list_stream_init(list, fd);
+
+        flags = fcntl(fd, F_GETFL);
+        if (flags >= 0)
+            flags = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+        if (unlikely(flags < 0))
+            die("failed to configure input: %s\n", errstr(errno));
+
+        return 0;
+    }
+
+    /* Regular files are used in place without copying any data */
+    if (S_ISREG(st.st_mode)) {
+        if (st.st_size > 0)
+            item_list_map(list, fd, (size_t) st.st_size);
+
+        return 0;
+    }
+
+    return -1;
+}
+
+void item_list_init(struct item_list *list,
+                    const char *dirs,
+                    const char *input,
+                    const struct item_fields *fields)
+{
+    int err;
+
+    TIMER_INIT_SIMPLE();
+
+    memset(list, 0, sizeof(*list));
+    list->fields = fields;
+    list->fd = -1;
+    list->offsets_len = -1;
+    list->keep = ITEM_LIST_PLAN_SELECTIVITY;
+    list->pass = ITEM_LIST_PLAN_SELECTIVITY;
+
+    dfa_init(&list->dfa);
+
+    if (input) {
+        int fd = open(input, O_RDONLY | O_CLOEXEC);
+        if (unlikely(fd < 0))
+            die("failed to open \"%s\": %s\n", input, errstr(errno));
+
+        err = item_list_load_fd(list, fd);
+        if (unlikely(err < 0))
+            die("\"%s\" is not a regular file or pipe\n", input);
+
+        goto out;
+    } else if (!dirs) {
+        /* Only items from standard input are optional */
+        list->fallback = true;
+
+        err = item_list_load_fd(list, STDIN_FILENO);
+        if (!err && (list->fd >= 0 || !item_list_empty(list)))
+            goto out;
+    }
+
+    /*
+     * No directory paths passed and nothing to read from stdin.
+     * Use default.
+     */
+    if (!dirs) {
+        dirs = getenv("PATH");
+        if (unlikely(!dirs))
+            die("failed to retrieve ${PATH} variable from environment\n");
+    }
+
+    /* Discard anything left over from an empty input */
+    item_list_reset(list);
+    list->fields = NULL;
+
+    item_list_load_from_directories(list, dirs);
+
+out:
+    /* Every item matches the empty lookup string */
+    item_list_lookup_apply(list, 0, list->n);
+}
+
+void item_list_destroy(struct item_list *list)
+{
+#ifdef MEM_NOLEAK
+    item_list_reset(list);
+    dfa_destroy(&list->dfa);
+    free(list->terms);
+#else
+    (void) list;
+#endif
+}
+
+static bool item_list_cancelled(const struct item_list *list)
+{
+    if (!list->cancel)
+        return false;
+
+    return atomic_load_explicit(list->cancel, memory_order_relaxed);
+}
+
+/*
+ * Splits the lookup string into its terms for approximate matching.
+ * Longer terms are allowed to contain more typos.
+ */
+static void item_list_approx_compile(struct item_list *list)
+{
+    int i = 0;
+
+    if (!list->terms) {
+        size_t size = ARRAY_SIZE(list->lookup) / 2 * sizeof(*list->terms);
+
+        list->terms = xmalloc(size);
+    }
+
+    list->n_terms = 0;
+
+    while (i < list->strlen) {
+        struct item_term *term = &list->terms[list->n_terms];
+        const char *str = list->lookup + i;
+        int len = 0;
+
+        while (i + len < list->strlen && str[len] != ' ')
+            ++len;
+
+        i += len + 1;
+
+        if (!len)
+            continue;
+
+        myers_init(&term->myers, str, (size_t) len);
+        memcpy(term->str, str, (size_t) len);
+
+        term->sig = item_list_sig(str, (size_t) len);
+        term->len = len;
+        term->k = MIN(len / ITEM_LIST_APPROX_CHARS, ITEM_LIST_APPROX_ERRORS);
+
+        ++list->n_terms;
+    }
+}
+
+static int item_list_rescan(struct item_list *list)
+{
+    uint64_t *set;
+    int count = 0;
+
+    TIMER_INIT_SIMPLE();
+
+    /*
+     * Patterns are often invalid while they are typed in, e.g. if a
+     * group is not closed yet. The previous pattern stays in effect
+     * until the pattern is valid again.
+     */
+    if (list->mode == APP_LIST_SEARCH_REGEX)
+        (void) dfa_compile(&list->dfa, list->lookup, list->strlen);
+    else
+        item_list_approx_compile(list);
+
+    list->stale = false;
+    list->n_spec = 0;
+
+    if (!list->strlen)
+        return 0;
+
+    /* These lookups cannot be narrowed down, so check all items */
+    set = item_list_match_set(list, list->strlen);
+    memset(set, 0, bitset_words((size_t) list->n) * sizeof(*set));
+
+    for (int i = 0; i < list->n; ++i) {
+        if (i % (64 * ITEM_LIST_CANCEL_WORDS) == 0 && item_list_cancelled(list))
+            goto cancel;
+
+        if (item_list_rescan_match(list, i)) {
+            bitset_set(set, (size_t) i);
+            ++count;
+        }
+    }
+
+    list->counts[list->strlen] = count;
+
+    return 0;
+
+cancel:
+    /* The bitset is incomplete until the lookup string is matched again */
+    list->stale = true;
+
+    return -ECANCELED;
+}
+
+void item_list_set_mode(struct item_list *list, int mode)
+{
+    char lookup[ARRAY_SIZE(list->lookup)];
+    int len = list->strlen;
 
-    for (int i = 0; i < list->n; ++i) {
-        if (list->items[i].score != list->strlen - 1)
+    if (list->mode == mode)
+        return;
+
+    list->mode = mode;
+
+    if (!item_list_narrowable(list)) {
+        list->ac_valid = false;
+        list->top_valid = false;
+        list->offsets_len = -1;
+
+        (void) item_list_rescan(list);
+        return;
+    }
+
+    memcpy(lookup, list->lookup, sizeof(lookup));
+
+    item_list_lookup_clear(list);
+
+    /* Rebuild the bitsets of all prefixes of the lookup string */
+    (void) item_list_lookup_push_str(list, lookup, len);
+}
+
+void item_list_lookup_clear(struct item_list *list)
+{
+    /* Clear lookup string, all items match again */
+    while (list->strlen)
+        list->lookup[list->strlen--] = '\0';
+
+    list->ac_valid = false;
+    list->top_valid = false;
+    list->offsets_len = -1;
+    list->n_spec = 0;
+
+    if (!item_list_narrowable(list))
+        (void) item_list_rescan(list);
+}
+
+/*
+ * Ways to narrow down the matching items: check the signature of each
+ * remaining item, intersect the remaining items with the index or scan
+ * each remaining item once for several new characters.
+ */
+#define ITEM_LIST_PLAN_SURVIVORS 0
+#define ITEM_LIST_PLAN_INDEX 1
+#define ITEM_LIST_PLAN_SCAN 2
+
+struct item_list_plan {
+    int type;
+    const char *name;
+    double cost;
+
+    /* Character buckets the remaining items have to contain */
+    uint64_t sig;
+
+    /* Resume the search for the last term at its previous first match */
+    bool resume;
+
+    /* Number of items passing the buckets, set by item_list_narrow() */
+    int candidates;
+};
+
+/* Returns the average length of the text items are matched against */
+static double item_list_text_len(const struct item_list *list)
+{
+    if (!list->n)
+        return 0.0;
+
+    if (list->mode == APP_LIST_SEARCH_ACRONYM)
+        return (double) list->initials_len / list->n;
+
+    return (double) list->text_len / list->n;
+}
+
+/*
+ * Picks the cheaper way to narrow down 'count' matching items to the
+ * ones containing another character. The items lack the character
+ * buckets in 'sig', if any.
+ */
+static void item_list_plan_narrow(const struct item_list *list,
+                                  struct item_list_plan *plan,
+                                  double count,
+                                  uint64_t sig)
+{
+    double n_words = (double) bitset_words((size_t) list->n);
+    double verify = count * item_list_text_len(list) * ITEM_LIST_COST_BYTE;
+    double cost;
+
+    plan->type = ITEM_LIST_PLAN_SURVIVORS;
+    plan->name = "survivors";
+    plan->cost = verify;
+    plan->sig = sig;
+    plan->resume = false;
+    plan->candidates = 0;
+
+    if (!sig)
+        return;
+
+    verify *= list->pass;
+    plan->cost = count * ITEM_LIST_COST_SIG + verify;
+
+    /* The index pays off as long as most bitset words are populated */
+    cost = n_words * __builtin_popcountll(sig) * ITEM_LIST_COST_WORD;
+    cost += verify;
+
+    if (cost < plan->cost) {
+        plan->type = ITEM_LIST_PLAN_INDEX;
+        plan->name = "index";
+        plan->cost = cost;
+    }
+}
+
+/*
+ * Picks the cheapest way to extend the bitsets of the lookup string
+ * from its first 'len' characters to all of them: one character after
+ * another or by a single scan of the remaining items. The number of
+ * items left after each character is estimated from earlier keystrokes.
+ */
+static void item_list_plan_extend(const struct item_list *list,
+                                  struct item_list_plan *plan,
+                                  int len)
+{
+    struct item_list_plan step;
+    double n_words = (double) bitset_words((size_t) list->n);
+    double count = list->counts[len], cost = 0.0;
+    uint64_t sig = item_list_lookup_sig(list, len);
+
+    for (int i = len; i < list->strlen; ++i) {
+        uint64_t next = item_list_lookup_sig(list, i + 1);
+
+        if (list->lookup[i] == ' ') {
+            cost += n_words * ITEM_LIST_COST_WORD;
             continue;
+        }
+
+        item_list_plan_narrow(list, &step, count, next & ~sig);
+
+        cost += step.cost;
+        count *= list->keep;
+        sig = next;
+    }
+
+    plan->type = ITEM_LIST_PLAN_SURVIVORS;
+    plan->name = "narrow";
+    plan->cost = cost;
+    plan->resume = false;
+    plan->candidates = 0;
+
+    /* Items lacking the first new character keep their previous depth */
+    plan->sig = item_list_lookup_sig(list, len + 1);
+    plan->sig &= ~item_list_lookup_sig(list, len);
+
+    count = list->counts[len];
+    cost = count * item_list_text_len(list) * ITEM_LIST_COST_AC;
+
+    if (plan->sig)
+        cost = count * ITEM_LIST_COST_SIG + list->pass * cost;
+
+    if (cost < plan->cost) {
+        plan->type = ITEM_LIST_PLAN_SCAN;
+        plan->name = "scan";
+        plan->cost = cost;
+    }
+}
+
+/* Updates the selectivity estimates after narrowing down 'count' items */
+static void item_list_plan_observe(struct item_list *list,
+                                   const struct item_list_plan *plan,
+                                   int count,
+                                   int result)
+{
+    double keep;
+
+    if (!count)
+        return;
 
-        if (!strstr(list->items[i].name, list->lookup))
+    keep = (double) result / count;
+
+    list->keep += ITEM_LIST_PLAN_WEIGHT * (keep - list->keep);
+
+    if (plan->sig && plan->type != ITEM_LIST_PLAN_SCAN) {
+        double pass = (double) plan->candidates / count;
+
+        list->pass += ITEM_LIST_PLAN_WEIGHT * (pass - list->pass);
+    }
+}
+
+/*
+ * Narrows the items of 'prev' down to the ones containing 'term' and
+ * stores them in 'set' as chosen by 'plan'. The first match of each
+ * matching item is stored in 'offsets' unless it is NULL. Returns the
+ * number of matching items or -ECANCELED if the lookup was cancelled.
+ */
+static int item_list_narrow(const struct item_list *list,
+                            const uint64_t *prev,
+                            uint64_t *set,
+                            const char *term,
+                            size_t size,
+                            struct item_list_plan *plan,
+                            uint32_t *offsets)
+{
+    const uint64_t *sigs = list->sigs;
+    size_t n_words = bitset_words((size_t) list->n);
+    char buf[ARRAY_SIZE(list->lookup)];
+    uint64_t sig = plan->sig;
+    int count = 0;
+
+    term = item_list_term(list, term, size, buf);
+    plan->candidates = 0;
+
+    /*
+     * Only the items matching the previous lookup string can match
+     * the new one. Walk the set bits of the previous bitset and
+     * overwrite the bitset for the new lookup string as a whole.
+     */
+    for (size_t i = 0; i < n_words; ++i) {
+        uint64_t bits = prev[i], word = 0;
+
+        if (i % ITEM_LIST_CANCEL_WORDS == 0 && item_list_cancelled(list))
+            return -ECANCELED;
+
+        /*
+         * Items lacking any of the characters of the lookup string
+         * cannot contain it. Reject them by the index or by their
+         * signature first.
+         */
+        if (plan->type == ITEM_LIST_PLAN_INDEX) {
+            for (uint64_t tmp = sig; tmp; tmp &= tmp - 1)
+                bits &= list->index[__builtin_ctzll(tmp)][i];
+        } else if (sig) {
+            for (uint64_t tmp = bits; tmp; tmp &= tmp - 1) {
+                int j = __builtin_ctzll(tmp);
+
+                if ((sigs[i * 64 + j] & sig) != sig)
+                    bits &= ~((uint64_t) 1 << j);
+            }
+        }
+
+        plan->candidates += __builtin_popcountll(bits);
+
+        while (bits) {
+            int index = (int) (i * 64) + __builtin_ctzll(bits);
+            size_t from = (plan->resume) ? offsets[index] : 0;
+            long offset = item_list_find(list, index, term, size, from);
+
+            if (offset >= 0) {
+                if (offsets)
+                    offsets[index] = (uint32_t) offset;
+
+                word |= bits & -bits;
+            }
+
+            bits &= bits - 1;
+        }
+
+        set[i] = word;
+        count += __builtin_popcountll(word);
+    }
+
+    return count;
+}
+
+/* Returns the last, possibly empty term of the first 'len' characters */
+static const char *item_list_lookup_term(const struct item_list *list,
+                                         int len)
+{
+    const char *term = memrchr(list->lookup, ' ', (size_t) len);
+
+    return (term) ? term + 1 : list->lookup;
+}
+
+/*
+ * Installs the bitset computed ahead of time for the lookup string
+ * extended by 'c'. Returns false if 'c' was not predicted.
+ */
+static bool item_list_spec_take(struct item_list *list, int c)
+{
+    for (int i = 0; i < list->n_spec; ++i) {
+        uint64_t *set;
+
+        if (list->spec_chars[i] != c)
             continue;
 
-        list->items[i].score = list->strlen;
+        set = list->matches[list->strlen];
+        list->matches[list->strlen] = list->spec_sets[i];
+        list->counts[list->strlen] = list->spec_counts[i];
+        list->spec_sets[i] = set;
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Computes the bitset of the first 'len' characters of the lookup string
+ * from the one of the characters before. Returns -ECANCELED if the lookup
+ * was cancelled.
+ */
+static int item_list_step(struct item_list *list, int len)
+{
+    struct item_list_plan plan;
+    const uint64_t *prev = list->matches[len - 1];
+    uint64_t *set = item_list_match_set(list, len);
+    size_t n_words = bitset_words((size_t) list->n);
+    const char *term;
+    uint64_t sig;
+    int count;
+
+    /* Starting a new term does not change the set of matching items */
+    if (list->lookup[len - 1] == ' ') {
+        memcpy(set, prev, n_words * sizeof(*set));
+        list->counts[len] = list->counts[len - 1];
+        return 0;
+    }
+
+    /*
+     * Items matching the previous lookup string already contain all
+     * other terms and all characters seen so far, so only the last
+     * term and the new character buckets need to be searched for.
+     */
+    term = item_list_lookup_term(list, len);
+    sig = item_list_lookup_sig(list, len);
+    sig &= ~item_list_lookup_sig(list, len - 1);
+
+    item_list_plan_narrow(list, &plan, list->counts[len - 1], sig);
+
+    /*
+     * The term can only be found at or after the first match of its
+     * previous characters. Offsets are overwritten in place, so they
+     * are invalid until the narrowing completes.
+     */
+    plan.resume = list->offsets_len == len - 1;
+    list->offsets_len = -1;
+
+    count = item_list_narrow(list,
+                             prev,
+                             set,
+                             term,
+                             (size_t) (list->lookup + len - term),
+                             &plan,
+                             list->offsets);
+    if (count < 0)
+        return count;
+
+    list->offsets_len = len;
+
+    TIMER_NOTE("Plan \"%s\": %s, cost %.0f, candidates %d, matches %d\n",
+               __func__,
+               plan.name,
+               plan.cost,
+               plan.candidates,
+               count);
+
+    item_list_plan_observe(list, &plan, list->counts[len - 1], count);
+    list->counts[len] = count;
+
+    return 0;
+}
+
+int item_list_lookup_push_back(struct item_list *list, int c)
+{
+    int err;
+
+    TIMER_INIT_SIMPLE();
+
+    if (list->strlen >= ARRAY_SIZE(list->lookup) - 1 || !isascii(c))
+        return 0;
+
+    list->lookup[list->strlen++] = (char) c;
+    list->ac_valid = false;
+    list->top_valid = false;
+
+    if (!item_list_narrowable(list))
+        return item_list_rescan(list);
+
+    if (item_list_spec_take(list, c)) {
+        list->n_spec = 0;
+        return 0;
+    }
+
+    list->n_spec = 0;
+
+    err = item_list_step(list, list->strlen);
+    if (err < 0) {
+        /* The bitset for the previous lookup string is still intact */
+        list->lookup[--list->strlen] = '\0';
+
+        return err;
+    }
+
+    return 0;
+}
+
+int item_list_lookup_push_str(struct item_list *list, const char *str, int len)
+{
+    struct item_list_plan plan;
+    const uint64_t *prev, *sigs = list->sigs;
+    int strlen = list->strlen;
+    size_t n_words;
+    uint64_t sig;
+
+    /* A single character may have been looked up ahead of time */
+    if (len == 1)
+        return item_list_lookup_push_back(list, str[0]);
+
+    TIMER_INIT_SIMPLE();
+
+    for (int i = 0; i < len; ++i) {
+        if (list->strlen >= ARRAY_SIZE(list->lookup) - 1)
+            break;
+
+        if (isascii(str[i]))
+            list->lookup[list->strlen++] = str[i];
+    }
+
+    if (list->strlen == strlen)
+        return 0;
+
+    list->ac_valid = false;
+    list->top_valid = false;
+    list->n_spec = 0;
+
+    if (!item_list_narrowable(list))
+        return item_list_rescan(list);
+
+    item_list_plan_extend(list, &plan, strlen);
+
+    TIMER_NOTE("Plan \"%s\": %s, cost %.0f, characters %d\n",
+               __func__,
+               plan.name,
+               plan.cost,
+               list->strlen - strlen);
+
+    if (plan.type != ITEM_LIST_PLAN_SCAN) {
+        for (int i = strlen + 1; i <= list->strlen; ++i) {
+            if (item_list_step(list, i) < 0)
+                goto cancel;
+        }
+
+        return 0;
+    }
+
+    n_words = bitset_words((size_t) list->n);
+
+    for (int i = strlen + 1; i <= list->strlen; ++i) {
+        uint64_t *set = item_list_match_set(list, i);
+
+        memset(set, 0, n_words * sizeof(*set));
+        list->counts[i] = 0;
+    }
+
+    item_list_build_ac(list);
+
+    prev = list->matches[strlen];
+    sig = plan.sig;
+
+    /*
+     * Instead of narrowing down the matching items character by
+     * character, find the depth of each previously matching item with
+     * a single scan of its name. This also yields the bitsets of all
+     * intermediate lookup strings.
+     */
+    for (size_t i = 0; i < n_words; ++i) {
+        uint64_t bits = prev[i];
+
+        if (i % ITEM_LIST_CANCEL_WORDS == 0 && item_list_cancelled(list))
+            goto cancel;
+
+        while (bits) {
+            int index = (int) (i * 64) + __builtin_ctzll(bits);
+            int depth;
+
+            bits &= bits - 1;
+
+            if ((sigs[index] & sig) != sig)
+                continue;
+
+            depth = item_list_match_depth(list, index);
+
+            for (int j = strlen + 1; j <= depth; ++j) {
+                bitset_set(list->matches[j], (size_t) index);
+                ++list->counts[j];
+            }
+        }
+    }
+
+    for (int i = strlen + 1; i <= list->strlen; ++i) {
+        if (list->lookup[i - 1] != ' ')
+            item_list_plan_observe(list,
+                                   &plan,
+                                   list->counts[i - 1],
+                                   list->counts[i]);
     }
+
+    return 0;
+
+cancel:
+    /* The bitset for the previous lookup string is still intact */
+    while (list->strlen > strlen)
+        list->lookup[--list->strlen] = '\0';
+
+    list->ac_valid = false;
+    list->top_valid = false;
+
+    return -ECANCELED;
 }
 
-void item_list_lookup_pop_back(struct item_list *list)
+int item_list_lookup_pop_back(struct item_list *list)
 {
     if (list->strlen)
         list->lookup[--list->strlen] = '\0';
 
-    for (int i = 0; i < list->n; ++i) {
-        if (list->items[i].score < list->strlen + 1)
-            continue;
+    list->ac_valid = false;
+    list->top_valid = false;
+    list->n_spec = 0;
+
+    /* The offsets of longer lookup strings are behind the shorter ones */
+    if (list->offsets_len > list->strlen)
+        list->offsets_len = -1;
+
+    /* Otherwise, the bitset for the shorter lookup string is up to date */
+    if (!item_list_narrowable(list))
+        return item_list_rescan(list);
+
+    return 0;
+}
 
-        list->items[i].score = list->strlen;
+/*
+ * Counts the characters following the last term of the lookup string in
+ * a sample of the matching items. If the last term is empty, any
+ * character of an item's name or initials may start it.
+ */
+static void item_list_spec_histogram(const struct item_list *list,
+                                     const char *term,
+                                     size_t size,
+                                     int hist[128])
+{
+    const uint64_t *set = list->matches[list->strlen];
+    size_t n_words = bitset_words((size_t) list->n);
+    int n = 0;
+
+    for (size_t i = 0; i < n_words && n < ITEM_LIST_SPEC_SAMPLE; ++i) {
+        for (uint64_t bits = set[i]; bits; bits &= bits - 1) {
+            int index = (int) (i * 64) + __builtin_ctzll(bits);
+            size_t len;
+            const char *name = item_list_text(list, index, &len);
+            const char *end = name + len;
+            uint64_t seen[2] = { 0, 0 };
+
+            /* Count each character only once per item */
+            while (name < end) {
+                unsigned char c;
+
+                if (size) {
+                    name = memmem(name, (size_t) (end - name), term, size);
+                    if (!name || name + size >= end)
+                        break;
+
+                    c = (unsigned char) name[size];
+                } else {
+                    c = (unsigned char) *name;
+                }
+
+                ++name;
+
+                if (c >= 128 || (seen[c / 64] & ((uint64_t) 1 << (c % 64))))
+                    continue;
+
+                seen[c / 64] |= (uint64_t) 1 << (c % 64);
+                ++hist[c];
+            }
+
+            ++n;
+        }
+    }
+}
+
+int item_list_speculate(struct item_list *list)
+{
+    struct item_list_plan plan;
+    char term[ARRAY_SIZE(list->lookup)];
+    int hist[128] = { 0 };
+    const char *last;
+    size_t size, n_bytes;
+    uint64_t sig, next;
+    int max;
+
+    TIMER_INIT_SIMPLE();
+
+    if (!item_list_narrowable(list) || list->stale || list->n_spec)
+        return 0;
+
+    if (list->strlen >= ARRAY_SIZE(list->lookup) - 1)
+        return 0;
+
+    if (!list->counts[list->strlen] || !list->match_max)
+        return 0;
+
+    n_bytes = bitset_words((size_t) list->match_max) * sizeof(uint64_t);
+    max = (int) MIN(ITEM_LIST_SPEC_BUDGET / n_bytes,
+                    (size_t) ITEM_LIST_SPEC_MAX);
+
+    last = item_list_lookup_term(list, list->strlen);
+    size = (size_t) (list->lookup + list->strlen - last);
+
+    if (item_list_term(list, last, size, term) == last)
+        memcpy(term, last, size);
+
+    item_list_spec_histogram(list, term, size, hist);
+
+    sig = item_list_lookup_sig(list, list->strlen);
+
+    while (list->n_spec < max) {
+        int c = 0, count;
+
+        /* Starting a new term with a space is cheap anyway */
+        for (int i = 1; i < ARRAY_SIZE(hist); ++i) {
+            if (hist[i] > hist[c] && isgraph(i))
+                c = i;
+        }
+
+        if (!hist[c])
+            break;
+
+        hist[c] = 0;
+
+        if (!list->spec_sets[list->n_spec])
+            list->spec_sets[list->n_spec] = xcalloc(1, n_bytes);
+
+        term[size] = (char) c;
+
+        next = 0;
+        if (list->mode != APP_LIST_SEARCH_ACRONYM)
+            next = item_list_sig_bit((unsigned char) c) & ~sig;
+
+        item_list_plan_narrow(list,
+                              &plan,
+                              list->counts[list->strlen],
+                              next);
+
+        count = item_list_narrow(list,
+                                 list->matches[list->strlen],
+                                 list->spec_sets[list->n_spec],
+                                 term,
+                                 size + 1,
+                                 &plan,
+                                 NULL);
+        if (count < 0)
+            return count;
+
+        list->spec_chars[list->n_spec] = (char) c;
+        list->spec_counts[list->n_spec] = count;
+        ++list->n_spec;
+    }
+
+    return 0;
+}
+
+int item_list_rank(struct item_list *list)
+{
+    const uint64_t *set = list->matches[list->strlen];
+    size_t n_words = bitset_words((size_t) list->n);
+    uint64_t need = 0;
+    bool slash = false;
+
+    TIMER_INIT_SIMPLE();
+
+    if (list->top_valid)
+        return 0;
+
+    list->n_top = 0;
+
+    if (list->mode != APP_LIST_SEARCH_PATH) {
+        list->top_valid = true;
+        return 0;
+    }
+
+    if (!list->ac_valid)
+        item_list_build_ac(list);
+
+    /* Only terms without a slash can be contained in a base name */
+    for (int i = 0; i < list->strlen; ++i) {
+        char c = list->lookup[i];
+        bool last = i + 1 == list->strlen || list->lookup[i + 1] == ' ';
+
+        slash = c != ' ' && (slash || c == '/');
+
+        if (c != ' ' && last && !slash)
+            need |= (uint64_t) 1 << list->ac_states[i];
+    }
+
+    if (!need) {
+        list->top_valid = true;
+        return 0;
+    }
+
+    if (!list->top) {
+        size_t size = bitset_words((size_t) list->match_max) * sizeof(*set);
+
+        list->top = xmalloc(size);
+    }
+
+    for (size_t i = 0; i < n_words; ++i) {
+        uint64_t word = 0;
+
+        if (i % ITEM_LIST_CANCEL_WORDS == 0 && item_list_cancelled(list))
+            return -ECANCELED;
+
+        for (uint64_t bits = set[i]; bits; bits &= bits - 1) {
+            int index = (int) (i * 64) + __builtin_ctzll(bits);
+            const char *name = item_list_name(list, index);
+            size_t base = item_list_basename(list, index);
+            size_t len = item_list_name_len(list, index) - base;
+            uint64_t seen = aho_corasick_scan(&list->ac, name + base, len);
+
+            if ((seen & need) == need)
+                word |= (uint64_t) 1 << __builtin_ctzll(bits);
+        }
+
+        list->top[i] = word;
+        list->n_top += __builtin_popcountll(word);
     }
+
+    list->top_valid = true;
+
+    return 0;
 }
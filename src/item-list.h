@@ -18,55 +18,376 @@
 #ifndef ITEM_LIST_H_
 #define ITEM_LIST_H_
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dfa.h"
+
+#include "util/aho-corasick.h"
+#include "util/bitset.h"
+#include "util/myers.h"
+#include "util/vmem.h"
 
 #define APP_LIST_SEARCH_SUBSTRING 0
 #define APP_LIST_SEARCH_PREFIX 1
+#define APP_LIST_SEARCH_REGEX 2
+#define APP_LIST_SEARCH_ACRONYM 3
+#define APP_LIST_SEARCH_APPROX 4
+#define APP_LIST_SEARCH_PATH 5
+
+/* Upper bound for the number of lookups computed ahead of time */
+#define ITEM_LIST_SPEC_MAX 8
+
+/*
+ * Selects which fields of a delimited input line are used as item name
+ * and which are written out on selection. Fields are counted from 1 and
+ * a 'last' value of 0 selects all remaining fields of the line.
+ */
+struct item_fields {
+    int delim;
+    int with_first;
+    int with_last;
+    int out_first;
+    int out_last;
+};
 
+/* Term of the lookup string in approximate mode with its allowed typos */
+struct item_term {
+    struct myers myers;
+    char str[MYERS_MAX_LEN];
+    uint64_t sig;
+    int len;
+    int k;
+};
+
+/* Span of an item's name relative to the base of the item list */
 struct item {
-    char *name;
-    int score;
+    uint32_t offset;
+    uint32_t len;
 };
 
+/*
+ * Items are kept in separate arrays to need as little memory as possible
+ * for very large inputs. An item only consists of the 32 bit span of its
+ * name within 'base' and a single bit per prefix of the lookup string.
+ */
 struct item_list {
+    const char *base;
     struct item *items;
     int n;
     int n_max;
 
+    /* Span of the output of each item if input lines are split */
+    struct item *outs;
+
+    /* Space separated terms, all of which an item has to contain */
     char lookup[64];
     int strlen;
 
+    /*
+     * Automaton for all terms of the lookup string with the state reached
+     * after each of its characters. Rebuilt on demand after the lookup
+     * string changed.
+     */
+    struct aho_corasick ac;
+    uint8_t ac_states[64];
+    bool ac_valid;
+
+    /*
+     * In regex mode, the lookup string is a regular expression. In
+     * approximate mode, the terms may be contained with a few typos.
+     * Only the bitset for the current lookup string is kept up to date
+     * in both modes.
+     */
+    int mode;
+    struct dfa dfa;
+    struct item_term *terms;
+    int n_terms;
+
+    /*
+     * Lookups are abandoned as soon as 'cancel' is set. A cancelled
+     * regex lookup leaves an incomplete bitset behind and marks the
+     * list as stale until the lookup string is changed again.
+     */
+    const atomic_bool *cancel;
+    bool stale;
+
+    /*
+     * Bit 'i' of 'matches[k]' is set if item 'i' contains the first 'k'
+     * characters of the lookup string. The bitsets are allocated on
+     * demand and hold 'match_max' bits each.
+     */
+    uint64_t *matches[64];
+    int counts[64];
+    int match_max;
+
+    /*
+     * Offset of the first match of the last term of the first
+     * 'offsets_len' characters of the lookup string in the text of each
+     * item of 'matches[offsets_len]'. Any other change to the lookup
+     * string than appending a character invalidates them.
+     */
+    uint32_t *offsets;
+    int offsets_len;
+
+    /*
+     * Bitsets for the lookup string extended by each of 'spec_chars',
+     * computed while waiting for input. Any change to the lookup string
+     * invalidates them.
+     */
+    uint64_t *spec_sets[ITEM_LIST_SPEC_MAX];
+    int spec_counts[ITEM_LIST_SPEC_MAX];
+    char spec_chars[ITEM_LIST_SPEC_MAX];
+    int n_spec;
+
+    /*
+     * Signature of each item's name with one bit per character bucket,
+     * used to reject items before looking at their names.
+     */
+    uint64_t *sigs;
+
+    /*
+     * Bit 'i' of 'index[b]' is set if the name of item 'i' has any
+     * character of bucket 'b'. Intersecting the matching items with
+     * these bitsets rejects 64 items at once.
+     */
+    uint64_t *index[64];
+
+    /*
+     * Selectivity observed for previous keystrokes: the fraction of the
+     * matching items that still match after one more character and the
+     * fraction of them passing the signature check. Together with the
+     * total length of all names, they estimate the cost of each way to
+     * narrow down the matching items.
+     */
+    double keep;
+    double pass;
+    size_t text_len;
+
+    /*
+     * Lower case initials of the words of all names, back to back. The
+     * initials of item 'i' start at 'initials[bounds[i]]' and end where
+     * those of the next item start. In acronym mode, these are looked
+     * up instead of the names.
+     */
+    char *initials;
+    uint32_t *bounds;
+    size_t initials_len;
+    size_t initials_max;
+
+    /*
+     * Offsets of the slashes in the names of all items, stored like the
+     * initials. In path mode, terms without a slash have to be contained
+     * in a single path component.
+     */
+    uint16_t *parts;
+    uint32_t *part_bounds;
+    size_t parts_len;
+    size_t parts_max;
+
+    /*
+     * In path mode, the matching items whose base name contains all
+     * terms without a slash are shown first. Computed on demand.
+     */
+    uint64_t *top;
+    int n_top;
+    bool top_valid;
+
+    /* Items read from the cache reference this buffer */
     void *mem;
+
+    /* Names of the programs found in the directories of PATH */
+    char *names;
+
+    /* Field selection for input lines, NULL if lines are not split */
+    const struct item_fields *fields;
+
+    /* Items read from a regular file reference its memory mapping */
+    const char *map;
+    size_t map_size;
+
+    /* Items read from a stream reference this region */
+    struct vmem data;
+    size_t data_len;
+    size_t data_line;
+    int fd;
+
+    /* Use the programs in PATH if the input provides no items */
+    bool fallback;
 };
 
-void item_list_init(struct item_list *list, const char *dirs);
+void item_list_init(struct item_list *list,
+                    const char *dirs,
+                    const char *input,
+                    const struct item_fields *fields);
 
 void item_list_destroy(struct item_list *list);
 
+static inline int item_list_stream_fd(const struct item_list *list)
+{
+    return list->fd;
+}
+
+int item_list_stream_read(struct item_list *list);
+
 static inline bool item_list_empty(const struct item_list *list)
 {
     return list->n == 0;
 }
 
-void item_list_lookup_clear(struct item_list *list);
+static inline int item_list_mode(const struct item_list *list)
+{
+    return list->mode;
+}
 
-void item_list_lookup_push_back(struct item_list *list, int c);
+void item_list_set_mode(struct item_list *list, int mode);
 
-void item_list_lookup_pop_back(struct item_list *list);
+static inline void item_list_set_cancel(struct item_list *list,
+                                        const atomic_bool *cancel)
+{
+    list->cancel = cancel;
+}
 
-static inline const struct item *item_list_cbegin(const struct item_list *list)
+static inline bool item_list_stale(const struct item_list *list)
 {
-    return list->items;
+    return list->stale;
 }
 
-static inline const struct item *item_list_cend(const struct item_list *list)
+static inline const char *item_list_lookup(const struct item_list *list)
 {
-    return list->items + list->n;
+    return list->lookup;
 }
 
-static inline int item_list_lookup_score(const struct item_list *list)
+static inline int item_list_lookup_len(const struct item_list *list)
 {
     return list->strlen;
 }
 
+void item_list_lookup_clear(struct item_list *list);
+
+/*
+ * Changes the lookup string by a single character. Returns -ECANCELED
+ * if the lookup was cancelled, which leaves the previous lookup string
+ * in place unless the list became stale.
+ */
+int item_list_lookup_push_back(struct item_list *list, int c);
+
+/*
+ * Appends a whole string to the lookup string at the cost of a single
+ * lookup. Returns -ECANCELED like item_list_lookup_push_back().
+ */
+int item_list_lookup_push_str(struct item_list *list, const char *str, int len);
+
+int item_list_lookup_pop_back(struct item_list *list);
+
+/*
+ * Guesses the characters most likely to be typed next and computes the
+ * lookups for them in advance, so a following item_list_lookup_push_back()
+ * with one of them completes immediately. Returns -ECANCELED if cancelled.
+ */
+int item_list_speculate(struct item_list *list);
+
+static inline int item_list_size(const struct item_list *list)
+{
+    return list->n;
+}
+
+static inline const char *item_list_name(const struct item_list *list,
+                                         int index)
+{
+    return list->base + list->items[index].offset;
+}
+
+static inline int item_list_name_len(const struct item_list *list, int index)
+{
+    return (int) list->items[index].len;
+}
+
+static inline const char *item_list_output(const struct item_list *list,
+                                           int index)
+{
+    if (!list->outs)
+        return item_list_name(list, index);
+
+    return list->base + list->outs[index].offset;
+}
+
+static inline int item_list_output_len(const struct item_list *list,
+                                       int index)
+{
+    if (!list->outs)
+        return item_list_name_len(list, index);
+
+    return (int) list->outs[index].len;
+}
+
+/*
+ * Determines which of the matching items are shown first. Returns
+ * -ECANCELED if cancelled.
+ */
+int item_list_rank(struct item_list *list);
+
+/* Returns the bitset of the items shown first or NULL if there are none */
+static inline const uint64_t *item_list_top(const struct item_list *list)
+{
+    return (list->n_top) ? list->top : NULL;
+}
+
+static inline int item_list_top_count(const struct item_list *list)
+{
+    return list->n_top;
+}
+
+/* Returns the bitset of all items matching the lookup string */
+static inline const uint64_t *item_list_matches(const struct item_list *list)
+{
+    return list->matches[list->strlen];
+}
+
+/*
+ * Returns the offset of the first match of the last term of the lookup
+ * string in the name of each matching item, indexed by item, or NULL if
+ * they were not recorded for the current lookup string.
+ */
+static inline const uint32_t *item_list_offsets(const struct item_list *list)
+{
+    /* Acronyms are looked up in the initials instead of the names */
+    if (list->mode != APP_LIST_SEARCH_SUBSTRING
+        && list->mode != APP_LIST_SEARCH_PATH)
+        return NULL;
+
+    return (list->offsets_len == list->strlen) ? list->offsets : NULL;
+}
+
+static inline bool item_list_match(const struct item_list *list, int index)
+{
+    return bitset_test(list->matches[list->strlen], (size_t) index);
+}
+
+static inline int item_list_match_count(const struct item_list *list)
+{
+    return list->counts[list->strlen];
+}
+
+/* Returns the first matching item at or after 'index' or -1 */
+static inline int item_list_match_next(const struct item_list *list, int index)
+{
+    const uint64_t *set = list->matches[list->strlen];
+
+    return (int) bitset_next(set, (size_t) list->n, (size_t) index);
+}
+
+/* Returns the k-th matching item, counting from zero, or -1 */
+static inline int item_list_match_select(const struct item_list *list, int k)
+{
+    const uint64_t *set = list->matches[list->strlen];
+
+    if (k < 0)
+        return -1;
+
+    return (int) bitset_select(set, (size_t) list->n, (size_t) k);
+}
+
 #endif /* ITEM_LIST_H_ */
@@ -16,6 +16,8 @@
  */
 
 #include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -34,6 +36,14 @@ static void line_edit_update_background(struct line_edit *edit)
     w = edit->x2 - x;
     h = edit->y2 - y;
 
+    /* Everything else is drawn on top of the background */
+    damage_add(&edit->damage, edit->x1, edit->y1, edit->x2, edit->y2);
+
+    if (render_active(edit->render)) {
+        render_fill(edit->render, x, y, w, h, &edit->bg);
+        return;
+    }
+
     cairo_rectangle(edit->cairo, x, y, w, h);
 
     cairo_set_source_rgba(edit->cairo,
@@ -58,6 +68,15 @@ static void line_edit_update_glyphs(struct line_edit *edit)
     if (cursor)
         edit->str[edit->strlen++] = '_';
 
+    if (render_active(edit->render)
+        && render_text(edit->render,
+                       edit->glyph_x,
+                       edit->glyph_y,
+                       edit->str,
+                       edit->strlen,
+                       &edit->fg))
+        goto out;
+
     glyphs = edit->glyphs;
     n_glyphs = ARRAY_SIZE(edit->glyphs);
 
@@ -83,11 +102,67 @@ static void line_edit_update_glyphs(struct line_edit *edit)
 
     cairo_show_glyphs(edit->cairo, glyphs, n_glyphs);
 
+    if (glyphs != edit->glyphs)
+        cairo_glyph_free(glyphs);
+
+out:
     if (cursor)
         --edit->strlen;
+}
 
-    if (glyphs != edit->glyphs)
-        cairo_glyph_free(glyphs);
+static void line_edit_update_status(struct line_edit *edit)
+{
+    cairo_glyph_t glyphs[ARRAY_SIZE(edit->status)], *ptr = glyphs;
+    cairo_text_extents_t ext;
+    int n_glyphs = ARRAY_SIZE(glyphs);
+    cairo_status_t status;
+    double x;
+
+    if (!edit->status_len)
+        return;
+
+    /* Keep the same padding to the right border as to the left one */
+    x = edit->x2 - (edit->glyph_x - edit->x1);
+
+    if (render_active(edit->render)
+        && render_text(edit->render,
+                       (int) x - render_text_width(edit->render,
+                                                   edit->status,
+                                                   edit->status_len),
+                       edit->glyph_y,
+                       edit->status,
+                       edit->status_len,
+                       &edit->fg))
+        return;
+
+    cairo_scaled_font_text_extents(edit->font, edit->status, &ext);
+
+    x -= ext.x_advance;
+
+    status = cairo_scaled_font_text_to_glyphs(edit->font,
+                                              x,
+                                              edit->glyph_y,
+                                              edit->status,
+                                              edit->status_len,
+                                              &ptr,
+                                              &n_glyphs,
+                                              NULL,
+                                              NULL,
+                                              NULL);
+
+    if (unlikely(status != CAIRO_STATUS_SUCCESS))
+        die("failed to retrieve glyphs from text\n");
+
+    cairo_set_source_rgba(edit->cairo,
+                          edit->fg.red,
+                          edit->fg.green,
+                          edit->fg.blue,
+                          edit->fg.alpha);
+
+    cairo_show_glyphs(edit->cairo, ptr, n_glyphs);
+
+    if (ptr != glyphs)
+        cairo_glyph_free(ptr);
 }
 
 void line_edit_init(struct line_edit *edit)
@@ -141,12 +216,46 @@ void line_edit_configure(struct line_edit *edit,
     edit->glyph_y = edit->y1 + mid;
 }
 
-void line_edit_clear(struct line_edit *edit)
+void line_edit_set_text(struct line_edit *edit, const char *str, int len)
 {
     edit->strlen = 0;
 
-    line_edit_update_background(edit);
-    line_edit_update_glyphs(edit);
+    for (int i = 0; i < len && edit->strlen < ARRAY_SIZE(edit->str); ++i) {
+        if (isascii(str[i]))
+            edit->str[edit->strlen++] = str[i];
+    }
+
+    edit->dirty = true;
+}
+
+void line_edit_set_status(struct line_edit *edit, const char *fmt, ...)
+{
+    char status[ARRAY_SIZE(edit->status)];
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(status, sizeof(status), fmt, args);
+    va_end(args);
+
+    if (len < 0)
+        len = 0;
+
+    len = MIN(len, ARRAY_SIZE(status) - 1);
+
+    /* The status is set after every event, but rarely changes */
+    if (len == edit->status_len && memcmp(status, edit->status, len) == 0)
+        return;
+
+    memcpy(edit->status, status, (size_t) len + 1);
+    edit->status_len = len;
+    edit->dirty = true;
+}
+
+void line_edit_clear(struct line_edit *edit)
+{
+    edit->strlen = 0;
+    edit->dirty = true;
 }
 
 void line_edit_push_back(struct line_edit *edit, int c)
@@ -155,9 +264,17 @@ void line_edit_push_back(struct line_edit *edit, int c)
         return;
 
     edit->str[edit->strlen++] = (char) c;
+    edit->dirty = true;
+}
 
-    line_edit_update_background(edit);
-    line_edit_update_glyphs(edit);
+void line_edit_push_str(struct line_edit *edit, const char *str, int len)
+{
+    for (int i = 0; i < len && edit->strlen < ARRAY_SIZE(edit->str); ++i) {
+        if (isascii(str[i]))
+            edit->str[edit->strlen++] = str[i];
+    }
+
+    edit->dirty = true;
 }
 
 void line_edit_pop_back(struct line_edit *edit)
@@ -166,9 +283,7 @@ void line_edit_pop_back(struct line_edit *edit)
         return;
 
     --edit->strlen;
-
-    line_edit_update_background(edit);
-    line_edit_update_glyphs(edit);
+    edit->dirty = true;
 }
 
 void line_edit_draw(struct line_edit *edit)
@@ -177,4 +292,13 @@ void line_edit_draw(struct line_edit *edit)
 
     line_edit_update_background(edit);
     line_edit_update_glyphs(edit);
+    line_edit_update_status(edit);
+
+    edit->dirty = false;
+}
+
+void line_edit_update(struct line_edit *edit)
+{
+    if (edit->dirty)
+        line_edit_draw(edit);
 }
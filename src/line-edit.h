@@ -24,15 +24,21 @@
 
 #include <cairo.h>
 
+#include "render.h"
 #include "widget-common.h"
 
 struct line_edit {
     cairo_t *cairo;
     cairo_scaled_font_t *font;
+    struct render *render;
 
     char str[64];
     int strlen;
 
+    /* Right aligned status text, e.g. the number of matching items */
+    char status[32];
+    int status_len;
+
     cairo_glyph_t glyphs[64];
 
     uint32_t x1;
@@ -43,6 +49,10 @@ struct line_edit {
     uint32_t glyph_x;
     uint32_t glyph_y;
 
+    /* Set if the text or the status changed since it was last drawn */
+    bool dirty;
+    struct damage damage;
+
     struct color fg;
     struct color bg;
 };
@@ -68,6 +78,13 @@ static inline void line_edit_set_cairo(struct line_edit *edit, cairo_t *cairo)
     edit->cairo = cairo;
 }
 
+/* Draws with 'render' whenever it is active instead of with cairo */
+static inline void line_edit_set_render(struct line_edit *edit,
+                                        struct render *render)
+{
+    edit->render = render;
+}
+
 static inline uint32_t line_edit_width(const struct line_edit *edit)
 {
     return edit->x2 - edit->x1;
@@ -88,12 +105,43 @@ static inline void line_edit_set_bg(struct line_edit *edit, uint32_t rgba)
     color_set_u32(&edit->bg, rgba);
 }
 
+/* Returns the area drawn since the damage was last cleared */
+static inline const struct damage *
+line_edit_damage(const struct line_edit *edit)
+{
+    return &edit->damage;
+}
+
+static inline void line_edit_clear_damage(struct line_edit *edit)
+{
+    damage_clear(&edit->damage);
+}
+
+static inline bool line_edit_dirty(const struct line_edit *edit)
+{
+    return edit->dirty;
+}
+
+/*
+ * The following functions only change what is shown. It is drawn with
+ * line_edit_update() or line_edit_draw() afterwards.
+ */
+void line_edit_set_text(struct line_edit *edit, const char *str, int len);
+
+void line_edit_set_status(struct line_edit *edit, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
 void line_edit_clear(struct line_edit *edit);
 
 void line_edit_push_back(struct line_edit *edit, int c);
 
+void line_edit_push_str(struct line_edit *edit, const char *str, int len);
+
 void line_edit_pop_back(struct line_edit *edit);
 
 void line_edit_draw(struct line_edit *edit);
 
+/* Draws the line edit if it changed since it was last drawn */
+void line_edit_update(struct line_edit *edit);
+
 #endif /* LINE_EDIT_H_ */
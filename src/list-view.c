@@ -40,21 +40,75 @@ static inline const struct color *list_view_get_bg(const struct list_view *view,
     return view->bg + (index & 0x01);
 }
 
+/* Returns the color of the matching parts of a name or NULL if unused */
+static inline const struct color *
+list_view_get_match(const struct list_view *view, int index)
+{
+    const struct color *match = &view->match;
+
+    if (view->selected == index)
+        match = &view->match_sel;
+
+    return (match->alpha > 0.0) ? match : NULL;
+}
+
+/*
+ * Returns the matching item chosen before for the lookup string of the
+ * shown items or -1.
+ */
+static int list_view_pinned(const struct list_view *view)
+{
+    const struct search *search = &view->search;
+    int index;
+
+    if (!view->history)
+        return -1;
+
+    index = history_lookup(view->history,
+                           search_lookup(search),
+                           search_lookup_len(search));
+
+    if (index < 0 || !search_match(search, index))
+        return -1;
+
+    return index;
+}
+
 static void list_view_update_entry_list(struct list_view *view)
 {
-    const struct item *item, *end;
-    int n, score;
+    const struct search *search = &view->search;
+    int i, n, count, pinned, offset;
 
-    item = item_list_cbegin(view->items);
-    end = item_list_cend(view->items);
+    /* Keep the displayed page within the range of matching items */
+    count = search_count(search);
+    if (view->offset > count - view->max_entries)
+        view->offset = MAX(count - view->max_entries, 0);
+
+    /*
+     * The pinned item takes the first rank, all other items keep their
+     * order behind it. Skipping the pinned item shifts the ranks of the
+     * items after it by one.
+     */
+    pinned = list_view_pinned(view);
+    offset = view->offset;
     n = 0;
-    score = item_list_lookup_score(view->items);
 
-    while (n < view->max_entries && item != end) {
-        if (item->score == score)
-            view->entries[n++] = item->name;
+    if (pinned >= 0 && offset == 0)
+        view->entries[n++] = pinned;
+    else if (pinned >= 0)
+        --offset;
+
+    /* Only the indices are stored, names are resolved when drawn */
+    if (pinned >= 0 && search_rank(search, pinned) <= offset)
+        ++offset;
+
+    i = search_select(search, offset);
 
-        ++item;
+    while (n < view->max_entries && i >= 0) {
+        if (i != pinned)
+            view->entries[n++] = i;
+
+        i = search_next(search, i);
     }
 
     view->n_entries = n;
@@ -71,6 +125,74 @@ static void list_view_update_entry_list(struct list_view *view)
         view->selected = 0;
 }
 
+/* Adds a span to the ordered, disjoint 'spans' and merges overlaps */
+static void list_view_add_span(struct span *spans, int *n, int begin, int end)
+{
+    int i = 0, j;
+
+    while (i < *n && spans[i].end < begin)
+        ++i;
+
+    for (j = i; j < *n && spans[j].begin <= end; ++j) {
+        begin = MIN(begin, spans[j].begin);
+        end = MAX(end, spans[j].end);
+    }
+
+    memmove(spans + i + 1, spans + j, (size_t) (*n - j) * sizeof(*spans));
+
+    spans[i] = (struct span) { .begin = begin, .end = end };
+    *n += 1 - (j - i);
+}
+
+/*
+ * Finds the parts of the item's name matching the terms of the lookup
+ * string of the shown items. The search recorded where the last term
+ * was found, the other ones are only looked for in the few names on
+ * display. Returns the number of ordered, disjoint spans.
+ */
+static int list_view_spans(const struct list_view *view,
+                           int index,
+                           int entry,
+                           struct span *spans)
+{
+    const struct search *search = &view->search;
+    const char *name, *term, *end;
+    int n = 0, len, mode;
+
+    mode = search_lookup_mode(search);
+
+    if (mode != APP_LIST_SEARCH_SUBSTRING && mode != APP_LIST_SEARCH_PATH)
+        return 0;
+
+    if (entry < 0 || !list_view_get_match(view, index))
+        return 0;
+
+    name = item_list_name(view->items, entry);
+    len = item_list_name_len(view->items, entry);
+
+    term = search_lookup(search);
+    end = term + search_lookup_len(search);
+
+    while (term < end) {
+        const char *next = memchr(term, ' ', (size_t) (end - term));
+        int size = (int) (((next) ? next : end) - term);
+        long offset = (next) ? -1 : search_offset(search, entry);
+
+        if (offset < 0 && size > 0) {
+            const char *pos = memmem(name, (size_t) len, term, (size_t) size);
+
+            offset = (pos) ? pos - name : -1;
+        }
+
+        if (size > 0 && offset >= 0 && offset + size <= len)
+            list_view_add_span(spans, &n, (int) offset, (int) offset + size);
+
+        term = (next) ? next + 1 : end;
+    }
+
+    return n;
+}
+
 static void list_view_draw_lines(struct list_view *view)
 {
     cairo_antialias_t antialias;
@@ -83,6 +205,20 @@ static void list_view_draw_lines(struct list_view *view)
 
     h = 1 + (view->y2 - view->y1) / view->max_entries;
 
+    /* The line below each entry is the row right in front of the next */
+    if (render_active(view->render)) {
+        for (uint32_t y = view->y1 + h; y < view->y2; y += h) {
+            render_fill(view->render,
+                        view->x1,
+                        y - 1,
+                        view->x2 - view->x1,
+                        1,
+                        &view->lines);
+        }
+
+        return;
+    }
+
     for (uint32_t y = view->y1 + h; y < view->y2; y += h) {
         cairo_move_to(view->cairo, view->x1, y);
         cairo_line_to(view->cairo, view->x2, y);
@@ -110,92 +246,196 @@ static void list_view_update_entry_bg(struct list_view *view, int index)
     x = view->x1;
     y = view->y1 + index * (h + 1);
 
+    if (render_active(view->render)) {
+        render_fill(view->render, x, y, w, h, bg);
+        return;
+    }
+
     cairo_rectangle(view->cairo, x, y, w, h);
     cairo_set_source_rgba(view->cairo, bg->red, bg->green, bg->blue, bg->alpha);
     cairo_fill(view->cairo);
 }
 
+/* Returns the number of characters in the first 'len' bytes of 'str' */
+static int list_view_chars(const char *str, int len)
+{
+    int n = 0;
+
+    for (int i = 0; i < len; ++i)
+        n += ((unsigned char) str[i] & 0xc0) != 0x80;
+
+    return n;
+}
+
+static void list_view_show_glyphs(struct list_view *view,
+                                  const struct glyph_run *run,
+                                  int begin,
+                                  int end,
+                                  const struct color *color)
+{
+    if (begin >= end)
+        return;
+
+    cairo_set_source_rgba(view->cairo,
+                          color->red,
+                          color->green,
+                          color->blue,
+                          color->alpha);
+
+    cairo_show_glyphs(view->cairo, run->glyphs + begin, end - begin);
+}
+
 static void list_view_update_entry_fg(struct list_view *view, int index)
 {
     const struct color *fg = list_view_get_fg(view, index);
-    cairo_glyph_t *glyphs = view->glyphs;
-    int n_glyphs = ARRAY_SIZE(view->glyphs);
+    const struct color *match = list_view_get_match(view, index);
+    const struct list_view_row *row = view->rows + index;
+    const struct item_list *list = view->items;
+    const struct glyph_run *run;
+    int entry = view->entries[index];
+    const char *name = item_list_name(list, entry);
+    int len = item_list_name_len(list, entry);
+    int n_spans = row->n_spans, pos = 0;
     uint32_t x, y;
-    cairo_status_t status;
 
     x = view->glyph_x;
     y = view->glyph_y + index * (1 + (view->y2 - view->y1) / view->max_entries);
 
-    status = cairo_scaled_font_text_to_glyphs(view->font,
-                                              x,
-                                              y,
-                                              view->entries[index],
-                                              strlen(view->entries[index]),
-                                              &glyphs,
-                                              &n_glyphs,
-                                              NULL,
-                                              NULL,
-                                              NULL);
+    /* Names with characters missing from the atlas are left to cairo */
+    if (render_active(view->render)
+        && render_text_marked(view->render,
+                              x,
+                              y,
+                              name,
+                              len,
+                              fg,
+                              row->spans,
+                              n_spans,
+                              match))
+        return;
+
+    run = glyph_cache_get(&view->glyph_cache, entry, name, len);
 
-    if (unlikely(status != CAIRO_STATUS_SUCCESS))
-        die("failed to update text glyphs\n");
+    /* Spans can only be mapped to glyphs if each character has one */
+    if (n_spans && list_view_chars(name, len) != run->n_glyphs)
+        n_spans = 0;
 
-    cairo_set_source_rgba(view->cairo, fg->red, fg->green, fg->blue, fg->alpha);
+    /* Runs are laid out at the origin, move them to the row instead */
+    cairo_save(view->cairo);
+    cairo_translate(view->cairo, x, y);
 
-    cairo_show_glyphs(view->cairo, glyphs, n_glyphs);
+    for (int i = 0; i < n_spans; ++i) {
+        int begin = list_view_chars(name, row->spans[i].begin);
+        int end = list_view_chars(name, row->spans[i].end);
 
-    if (glyphs != view->glyphs)
-        cairo_glyph_free(glyphs);
+        list_view_show_glyphs(view, run, pos, begin, fg);
+        list_view_show_glyphs(view, run, begin, end, match);
+        pos = end;
+    }
+
+    list_view_show_glyphs(view, run, pos, run->n_glyphs, fg);
+    cairo_restore(view->cairo);
 }
 
-static void list_view_update_entry(struct list_view *view, int index)
+/* Draws the row at 'index' unless it already shows the same content */
+static bool list_view_update_entry(struct list_view *view, int index)
 {
+    struct span spans[LIST_VIEW_SPANS];
+    struct list_view_row *row;
+    const struct color *bg;
+    uint32_t y, h;
+    int entry, n_spans;
+    size_t size;
+
     if (index < 0)
-        return;
+        return false;
+
+    row = view->rows + index;
+    entry = (index < view->n_entries) ? view->entries[index] : -1;
+    bg = list_view_get_bg(view, index);
+
+    /* A row is also drawn again if other parts of its name match */
+    n_spans = list_view_spans(view, index, entry, spans);
+    size = (size_t) n_spans * sizeof(*spans);
+
+    if (row->entry == entry && row->bg == bg && row->n_spans == n_spans
+        && memcmp(row->spans, spans, size) == 0)
+        return false;
+
+    row->entry = entry;
+    row->bg = bg;
+    row->n_spans = n_spans;
+    memcpy(row->spans, spans, size);
+
+    h = (view->y2 - view->y1) / view->max_entries;
+    y = view->y1 + index * (h + 1);
+
+    damage_add(&view->damage, view->x1, y, view->x2, y + h);
 
     list_view_update_entry_bg(view, index);
 
-    if (index >= view->n_entries)
-        return;
+    if (entry >= 0)
+        list_view_update_entry_fg(view, index);
 
-    list_view_update_entry_fg(view, index);
+    return true;
 }
 
-static void list_view_update(struct list_view *view)
+void list_view_update(struct list_view *view)
 {
-    int num;
+    int n = 0;
 
     TIMER_INIT_SIMPLE();
 
-    /* Save number of currently displayed items. */
-    num = view->n_entries;
+    if (!view->dirty)
+        return;
 
-    list_view_update_entry_list(view);
+    view->dirty = false;
 
     /*
-     * The number of items which have to be displayed may have changed.
-     * Ensure that _all_ items are updated accordingly.
+     * Any number of changes may have been made since the last update,
+     * so all rows are checked. Most of them usually stay the same.
      */
-    num = MAX(num, view->n_entries);
+    for (int i = 0; i < view->max_entries; ++i)
+        n += list_view_update_entry(view, i);
 
-    for (int i = 0; i < num; ++i)
-        list_view_update_entry(view, i);
+    TIMER_NOTE("List view: %d of %d rows drawn\n", n, view->max_entries);
 }
 
 void list_view_init(struct list_view *view)
 {
     memset(view, 0, sizeof(*view));
+
+    glyph_cache_init(&view->glyph_cache);
 }
 
 void list_view_destroy(struct list_view *view)
 {
 #ifdef MEM_NOLEAK
+    if (view->items)
+        search_destroy(&view->search);
+
+    glyph_cache_destroy(&view->glyph_cache);
+    free(view->rows);
     free(view->entries);
 #else
     (void) view;
 #endif
 }
 
+void list_view_set_item_list(struct list_view *view, struct item_list *list)
+{
+    view->items = list;
+
+    search_init(&view->search, list);
+}
+
+void list_view_set_history(struct list_view *view, struct history *hist)
+{
+    view->history = hist;
+
+    history_resolve(hist, view->items);
+}
+
 void list_view_size_hint(const struct list_view *view,
                          const cairo_font_extents_t *ext,
                          uint32_t *width,
@@ -203,7 +443,7 @@ void list_view_size_hint(const struct list_view *view,
 {
     uint32_t w, h;
 
-    w = (uint32_t) (ARRAY_SIZE(view->glyphs) * ext->max_x_advance);
+    w = (uint32_t) (LIST_VIEW_COLUMNS * ext->max_x_advance);
     h = view->max_entries * (uint32_t) (1.25 * ext->height);
 
     /* Account for a separation line between all entries. */
@@ -224,6 +464,8 @@ void list_view_configure(struct list_view *view,
 
     view->font = cairo_get_scaled_font(view->cairo);
 
+    glyph_cache_set_font(&view->glyph_cache, view->font);
+
     view->x1 = x1;
     view->y1 = y1;
     view->x2 = x2;
@@ -238,81 +480,160 @@ void list_view_configure(struct list_view *view,
 
 void list_view_up(struct list_view *view)
 {
-    int prev;
-
     if (view->selected <= 0)
         return;
 
-    prev = view->selected--;
-
-    list_view_update_entry(view, prev);
-    list_view_update_entry(view, view->selected);
+    --view->selected;
+    view->dirty = true;
 }
 
 void list_view_down(struct list_view *view)
 {
-    int prev;
-
     if (view->selected >= view->n_entries - 1)
         return;
 
-    prev = view->selected++;
-
-    list_view_update_entry(view, prev);
-    list_view_update_entry(view, view->selected);
+    ++view->selected;
+    view->dirty = true;
 }
 
 void list_view_select_first(struct list_view *view)
 {
-    int prev;
+    if (view->offset > 0) {
+        view->offset = 0;
+        view->selected = 0;
+
+        list_view_update_entry_list(view);
+        view->dirty = true;
+        return;
+    }
 
     if (view->selected <= 0)
         return;
 
-    prev = view->selected;
     view->selected = 0;
-
-    list_view_update_entry(view, prev);
-    list_view_update_entry(view, view->selected);
+    view->dirty = true;
 }
 
 void list_view_select_last(struct list_view *view)
 {
-    int prev;
+    int offset;
+
+    offset = search_count(&view->search) - view->max_entries;
+
+    if (view->offset < offset) {
+        view->offset = offset;
+        view->selected = view->max_entries - 1;
+
+        list_view_update_entry_list(view);
+        view->dirty = true;
+        return;
+    }
 
     if (view->selected >= view->n_entries - 1)
         return;
 
-    prev = view->selected;
     view->selected = view->n_entries - 1;
+    view->dirty = true;
+}
+
+void list_view_page_up(struct list_view *view)
+{
+    if (view->offset <= 0) {
+        list_view_select_first(view);
+        return;
+    }
 
-    list_view_update_entry(view, prev);
-    list_view_update_entry(view, view->selected);
+    view->offset = MAX(view->offset - view->max_entries, 0);
+
+    list_view_update_entry_list(view);
+    view->dirty = true;
 }
 
-void list_view_lookup_push_back(struct list_view *view, int c)
+void list_view_page_down(struct list_view *view)
 {
-    TIMER_INIT_SIMPLE();
+    int count = search_count(&view->search);
+
+    if (view->offset + view->max_entries >= count) {
+        list_view_select_last(view);
+        return;
+    }
 
-    item_list_lookup_push_back(view->items, c);
+    /* Clamped to the last full page when the entries are updated */
+    view->offset += view->max_entries;
 
-    list_view_update(view);
+    list_view_update_entry_list(view);
+    view->dirty = true;
+}
+
+/*
+ * Lookups only submit the new lookup string to the search thread. The
+ * displayed entries are updated once its result arrives.
+ */
+void list_view_lookup_push_back(struct list_view *view, int c)
+{
+    search_push_back(&view->search, c);
+}
+
+void list_view_lookup_push_str(struct list_view *view,
+                               const char *str,
+                               int len)
+{
+    search_push_str(&view->search, str, len);
 }
 
 void list_view_lookup_pop_back(struct list_view *view)
+{
+    search_pop_back(&view->search);
+}
+
+void list_view_lookup_clear(struct list_view *view)
+{
+    search_clear(&view->search);
+}
+
+void list_view_set_search_mode(struct list_view *view, int mode)
+{
+    search_set_mode(&view->search, mode);
+}
+
+void list_view_search_update(struct list_view *view)
 {
     TIMER_INIT_SIMPLE();
 
-    item_list_lookup_pop_back(view->items);
+    if (!search_update(&view->search))
+        return;
+
+    view->offset = 0;
 
-    list_view_update(view);
+    list_view_update_entry_list(view);
+    view->dirty = true;
 }
 
-void list_view_lookup_clear(struct list_view *view)
+void list_view_stream_read(struct list_view *view)
 {
-    item_list_lookup_clear(view->items);
+    int n;
+
+    TIMER_INIT_SIMPLE();
+
+    /* The search thread reads the item list until its lookup is done */
+    if (!search_idle(&view->search))
+        return;
+
+    n = item_list_stream_read(view->items);
+
+    if (view->history)
+        history_resolve(view->history, view->items);
 
-    list_view_update(view);
+    search_sync(&view->search);
+
+    /*
+     * New items are always appended to the item list. If all rows are
+     * already occupied, they cannot show up anywhere.
+     */
+    if (n > 0 && view->n_entries < view->max_entries) {
+        list_view_update_entry_list(view);
+        view->dirty = true;
+    }
 }
 
 void list_view_draw(struct list_view *view)
@@ -322,6 +643,14 @@ void list_view_draw(struct list_view *view)
     list_view_draw_lines(view);
     list_view_update_entry_list(view);
 
-    for (int i = 0; i < view->max_entries; ++i)
-        list_view_update_entry(view, i);
+    view->dirty = false;
+
+    /* Everything is drawn from scratch, e.g. after a resize */
+    for (int i = 0; i < view->max_entries; ++i) {
+        view->rows[i].bg = NULL;
+
+        (void) list_view_update_entry(view, i);
+    }
+
+    damage_add(&view->damage, view->x1, view->y1, view->x2, view->y2);
 }
@@ -22,18 +22,46 @@
 
 #include <cairo.h>
 
+#include "glyph-cache.h"
+#include "history.h"
 #include "item-list.h"
+#include "render.h"
+#include "search.h"
 #include "widget-common.h"
 
 #include "util/xalloc.h"
 
+/* Width of the list view in characters */
+#define LIST_VIEW_COLUMNS 64
+
+/* Maximum number of space separated terms in a lookup string */
+#define LIST_VIEW_SPANS 32
+
+/*
+ * What a row was last drawn with. The background color tells both the
+ * parity of the row and whether it was selected. The spans are the
+ * parts of the item's name drawn in the match color.
+ */
+struct list_view_row {
+    int entry;
+    const struct color *bg;
+    struct span spans[LIST_VIEW_SPANS];
+    int n_spans;
+};
+
 struct list_view {
     cairo_t *cairo;
     cairo_scaled_font_t *font;
+    struct render *render;
 
-    cairo_glyph_t glyphs[64];
+    /* Glyphs of the items shown recently, keyed by their index */
+    struct glyph_cache glyph_cache;
 
     struct item_list *items;
+    struct search search;
+
+    /* Items chosen before for the lookup string are shown first */
+    struct history *history;
 
     uint32_t x1;
     uint32_t y1;
@@ -43,15 +71,27 @@ struct list_view {
     uint32_t glyph_x;
     uint32_t glyph_y;
 
-    const char **entries;
+    /* Items of the current page and the rank of its first item */
+    int *entries;
+    int offset;
     int selected;
     int n_entries;
     int max_entries;
 
+    /*
+     * Rows are only drawn again if their content changed. Set if any
+     * of them may have changed since the last update.
+     */
+    struct list_view_row *rows;
+    bool dirty;
+    struct damage damage;
+
     struct color fg;
     struct color bg[2];
     struct color fg_sel;
     struct color bg_sel[2];
+    struct color match;
+    struct color match_sel;
     struct color lines;
 };
 
@@ -64,17 +104,38 @@ static inline void list_view_set_cairo(struct list_view *view, cairo_t *cairo)
     view->cairo = cairo;
 }
 
-static inline void list_view_set_item_list(struct list_view *view,
-                                           struct item_list *list)
+/* Draws with 'render' whenever it is active instead of with cairo */
+static inline void list_view_set_render(struct list_view *view,
+                                        struct render *render)
 {
-    view->items = list;
+    view->render = render;
 }
 
+void list_view_set_item_list(struct list_view *view, struct item_list *list);
+
 static inline struct item_list *list_view_item_list(struct list_view *view)
 {
     return view->items;
 }
 
+void list_view_set_history(struct list_view *view, struct history *hist);
+
+static inline struct history *list_view_history(struct list_view *view)
+{
+    return view->history;
+}
+
+/* Lookup string of the shown items, used to record the executed item */
+static inline const char *list_view_lookup(const struct list_view *view)
+{
+    return search_lookup(&view->search);
+}
+
+static inline int list_view_lookup_len(const struct list_view *view)
+{
+    return search_lookup_len(&view->search);
+}
+
 void list_view_size_hint(const struct list_view *view,
                          const cairo_font_extents_t *ext,
                          uint32_t *width,
@@ -111,6 +172,18 @@ list_view_set_bg_sel(struct list_view *view, uint32_t rgba1, uint32_t rgba2)
     color_set_u32(view->bg_sel + 1, rgba2);
 }
 
+/* Matching parts of the names are not highlighted with transparent colors */
+static inline void list_view_set_match(struct list_view *view, uint32_t rgba)
+{
+    color_set_u32(&view->match, rgba);
+}
+
+static inline void list_view_set_match_sel(struct list_view *view,
+                                           uint32_t rgba)
+{
+    color_set_u32(&view->match_sel, rgba);
+}
+
 static inline void list_view_set_lines(struct list_view *view, uint32_t rgba)
 {
     color_set_u32(&view->lines, rgba);
@@ -119,17 +192,70 @@ static inline void list_view_set_lines(struct list_view *view, uint32_t rgba)
 static inline void list_view_set_max_rows(struct list_view *view, int n)
 {
     view->entries = xrealloc(view->entries, n * sizeof(*view->entries));
+    view->rows = xrealloc(view->rows, n * sizeof(*view->rows));
     view->max_entries = n;
+
+    /* Nothing has been drawn into the rows yet */
+    for (int i = 0; i < n; ++i)
+        view->rows[i] = (struct list_view_row) { .entry = -1, .bg = NULL };
 }
 
-static inline const char *list_view_get_entry(const struct list_view *view)
+static inline int list_view_get_entry(const struct list_view *view)
 {
     if (view->selected < 0 || view->selected >= view->n_entries)
-        return NULL;
+        return -1;
 
     return view->entries[view->selected];
 }
 
+static inline int list_view_search_fd(const struct list_view *view)
+{
+    return search_fd(&view->search);
+}
+
+static inline int list_view_search_mode(const struct list_view *view)
+{
+    return search_mode(&view->search);
+}
+
+static inline int list_view_match_count(const struct list_view *view)
+{
+    return search_count(&view->search);
+}
+
+/*
+ * Returns the file descriptor to read new items from or -1 if there is
+ * nothing to read. New items cannot be added while a lookup is running.
+ */
+static inline int list_view_input_fd(const struct list_view *view)
+{
+    if (!search_idle(&view->search))
+        return -1;
+
+    return item_list_stream_fd(view->items);
+}
+
+/* Returns the area drawn since the damage was last cleared */
+static inline const struct damage *
+list_view_damage(const struct list_view *view)
+{
+    return &view->damage;
+}
+
+static inline void list_view_clear_damage(struct list_view *view)
+{
+    damage_clear(&view->damage);
+}
+
+static inline bool list_view_dirty(const struct list_view *view)
+{
+    return view->dirty;
+}
+
+/*
+ * The following functions only change what is shown. It is drawn with
+ * list_view_update() or list_view_draw() afterwards.
+ */
 void list_view_up(struct list_view *view);
 
 void list_view_down(struct list_view *view);
@@ -138,12 +264,29 @@ void list_view_select_first(struct list_view *view);
 
 void list_view_select_last(struct list_view *view);
 
+void list_view_page_up(struct list_view *view);
+
+void list_view_page_down(struct list_view *view);
+
 void list_view_lookup_push_back(struct list_view *view, int c);
 
+void list_view_lookup_push_str(struct list_view *view,
+                               const char *str,
+                               int len);
+
 void list_view_lookup_pop_back(struct list_view *view);
 
 void list_view_lookup_clear(struct list_view *view);
 
+void list_view_set_search_mode(struct list_view *view, int mode);
+
+void list_view_search_update(struct list_view *view);
+
+void list_view_stream_read(struct list_view *view);
+
 void list_view_draw(struct list_view *view);
 
+/* Draws the rows which changed since they were last drawn */
+void list_view_update(struct list_view *view);
+
 #endif /* LIST_VIEW_H_ */
@@ -16,9 +16,11 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -28,6 +30,7 @@
 #include "util/string-util.h"
 
 #include "config.h"
+#include "history.h"
 #include "item-list.h"
 #include "timer.h"
 #include "window.h"
@@ -54,6 +57,17 @@
 static struct config conf;
 static struct window win;
 static struct item_list items;
+static struct history history;
+static const char *input;
+static const char *query;
+static struct item_fields fields = {
+    .delim = '\t',
+    .with_first = 1,
+    .with_last = 0,
+    .out_first = 1,
+    .out_last = 0,
+};
+static bool use_fields;
 
 static void help(void)
 {
@@ -65,6 +79,15 @@ static void help(void)
             "\n"
             "  --dry-run      Do not execute the selected entry. Instead,\n"
             "                 print it to standard output.\n"
+            "  --input FILE   Read the list of items from FILE instead of\n"
+            "                 standard input.\n"
+            "  --delimiter C  Split input lines into fields separated by\n"
+            "                 the character C. Defaults to a tab.\n"
+            "  --with-nth N   Display and search only field N of each\n"
+            "                 input line. Ranges are given as N..M or N..\n"
+            "  --output-nth N Print or execute only field N of the\n"
+            "                 selected input line. Takes ranges as well.\n"
+            "  --query STR    Start with STR as the lookup string.\n"
             "  --help,    -h  Print this help message and exit.\n"
             "  --version, -v  Print version information and exit.\n"
             "\n"
@@ -73,8 +96,9 @@ static void help(void)
             "variable.\n"
             "\n"
             "The program also supports reading in a list if newline separated\n"
-            "values from standard input. If data is available on stdin,\n"
-            "no other items will be displayed by crudebox.\n"
+            "values from standard input. If stdin is a pipe or a file,\n"
+            "no other items will be displayed by crudebox. Items from a\n"
+            "pipe are displayed as soon as they arrive.\n"
             "\n"
             "Extensive help for crudebox can be found here:\n"
             "<https://github.com/stnuessl/crudebox/blob/master/README.md>.\n"
@@ -105,15 +129,60 @@ static void version(void)
             "\n");
 }
 
+static int parse_delimiter(const char *arg)
+{
+    if (streq("\\t", arg))
+        return '\t';
+
+    if (strlen(arg) != 1)
+        die("invalid delimiter \"%s\": expected a single character\n", arg);
+
+    return (unsigned char) arg[0];
+}
+
+static void parse_field_range(const char *arg, int *first, int *last)
+{
+    const char *str;
+    char *end;
+    long n, m;
+    bool ok;
+
+    n = strtol(arg, &end, 10);
+    m = n;
+    ok = end != arg && n >= 1 && n <= INT_MAX;
+
+    if (ok && strncmp(end, "..", 2) == 0) {
+        str = end + 2;
+
+        /* An open range selects all remaining fields */
+        m = strtol(str, &end, 10);
+        if (end == str)
+            m = 0;
+        else
+            ok = m >= n && m <= INT_MAX;
+    }
+
+    if (!ok || *end != '\0')
+        die("invalid field range \"%s\"\n", arg);
+
+    *first = (int) n;
+    *last = (int) m;
+}
+
 static void *thread1_run(void *arg)
 {
     TIMER_INIT_SIMPLE();
 
     (void) arg;
 
-    item_list_init(&items, NULL);
+    item_list_init(&items, NULL, input, (use_fields) ? &fields : NULL);
+
+    /* Look up the initial query at once, before anything is drawn */
+    if (query)
+        (void) item_list_lookup_push_str(&items, query, (int) strlen(query));
 
     config_init(&conf);
+    history_init(&history);
 
     return NULL;
 }
@@ -138,17 +207,9 @@ int main(int argc, char *argv[])
     int err1, err2;
     bool dry_run;
 
-    err1 = pthread_create(&thread1, NULL, &thread1_run, NULL);
-    err2 = pthread_create(&thread2, NULL, &thread2_run, NULL);
-
-    if (err1 != 0)
-        (void) thread1_run(NULL);
-
-    if (err2 != 0)
-        (void) thread2_run(NULL);
-
     dry_run = false;
 
+    /* Options influence the item list, so parse them before loading it. */
     for (int i = 1; i < argc; ++i) {
         if (streq("-h", argv[i]) || streq("--help", argv[i])) {
             help();
@@ -158,11 +219,48 @@ int main(int argc, char *argv[])
             exit(EXIT_SUCCESS);
         } else if (streq("--dry-run", argv[i])) {
             dry_run = true;
+        } else if (streq("--input", argv[i])) {
+            if (++i >= argc)
+                die("missing argument for option \"%s\"\n", argv[i - 1]);
+
+            input = argv[i];
+        } else if (streq("--query", argv[i])) {
+            if (++i >= argc)
+                die("missing argument for option \"%s\"\n", argv[i - 1]);
+
+            query = argv[i];
+        } else if (streq("--delimiter", argv[i])) {
+            if (++i >= argc)
+                die("missing argument for option \"%s\"\n", argv[i - 1]);
+
+            fields.delim = parse_delimiter(argv[i]);
+            use_fields = true;
+        } else if (streq("--with-nth", argv[i])) {
+            if (++i >= argc)
+                die("missing argument for option \"%s\"\n", argv[i - 1]);
+
+            parse_field_range(argv[i], &fields.with_first, &fields.with_last);
+            use_fields = true;
+        } else if (streq("--output-nth", argv[i])) {
+            if (++i >= argc)
+                die("missing argument for option \"%s\"\n", argv[i - 1]);
+
+            parse_field_range(argv[i], &fields.out_first, &fields.out_last);
+            use_fields = true;
         } else {
             die("invalid option \"%s\"\n", argv[i]);
         }
     }
 
+    err1 = pthread_create(&thread1, NULL, &thread1_run, NULL);
+    err2 = pthread_create(&thread2, NULL, &thread2_run, NULL);
+
+    if (err1 != 0)
+        (void) thread1_run(NULL);
+
+    if (err2 != 0)
+        (void) thread2_run(NULL);
+
     (void) pthread_join(thread1, NULL);
     (void) pthread_join(thread2, NULL);
 
@@ -173,6 +271,7 @@ int main(int argc, char *argv[])
     /* Apply configuration to the elements */
     widget_set_font(widget, conf.font.path);
     widget_set_font_size(widget, conf.font.size);
+    widget_set_atlas(widget, conf.font.atlas != 0);
     widget_set_frame_color(widget, conf.widget.frame);
     widget_set_line_width(widget, conf.widget.line_width);
     widget_set_dry_run(widget, dry_run);
@@ -185,17 +284,23 @@ int main(int argc, char *argv[])
     list_view_set_fg_sel(view, conf.list_view.fg_sel);
     list_view_set_bg_sel(view, conf.list_view.bg1_sel, conf.list_view.bg2_sel);
     list_view_set_max_rows(view, conf.list_view.size);
+    list_view_set_match(view, conf.list_view.match);
+    list_view_set_match_sel(view, conf.list_view.match_sel);
     list_view_set_lines(view, conf.list_view.lines);
 
     widget_set_item_list(widget, &items);
+    widget_set_history(widget, &history);
 
     window_show(&win);
 
     window_dispatch_events(&win);
 
     config_destroy(&conf);
-    item_list_destroy(&items);
+
+    /* The window owns the search thread which reads the items */
     window_destroy(&win);
+    history_destroy(&history);
+    item_list_destroy(&items);
 
     return EXIT_SUCCESS;
 }
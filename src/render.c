@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <cairo-ft.h>
+
+#include "render.h"
+#include "timer.h"
+
+#include "util/macro.h"
+#include "util/simd.h"
+#include "util/xalloc.h"
+
+/* Converts a color to a premultiplied ARGB pixel value */
+static uint32_t render_pixel(const struct color *color)
+{
+    double a = color->alpha * 255.0;
+    uint32_t r, g, b;
+
+    r = (uint32_t) (color->red * a + 0.5);
+    g = (uint32_t) (color->green * a + 0.5);
+    b = (uint32_t) (color->blue * a + 0.5);
+
+    return (uint32_t) (a + 0.5) << 24 | r << 16 | g << 8 | b;
+}
+
+static int render_load_glyph(FT_Face face, int c)
+{
+    FT_Error error;
+
+    error = FT_Load_Char(face, (FT_ULong) c, FT_LOAD_RENDER);
+    if (unlikely(error))
+        return -1;
+
+    return 0;
+}
+
+static void render_copy_glyph(struct render *render, FT_GlyphSlot slot, int c)
+{
+    const FT_Bitmap *bitmap = &slot->bitmap;
+    size_t size = (size_t) (render->cell_width * render->cell_height);
+    uint8_t *cell = render->atlas + (size_t) (c - RENDER_FIRST_CHAR) * size;
+    int x0 = render->origin_x + slot->bitmap_left;
+    int y0 = render->origin_y - slot->bitmap_top;
+
+    for (unsigned int y = 0; y < bitmap->rows; ++y) {
+        const uint8_t *src = bitmap->buffer + (long) y * bitmap->pitch;
+        uint8_t *dst = cell + (y0 + (int) y) * render->cell_width + x0;
+
+        for (unsigned int x = 0; x < bitmap->width; ++x) {
+            if (bitmap->pixel_mode == FT_PIXEL_MODE_MONO)
+                dst[x] = (src[x / 8] & (0x80 >> (x % 8))) ? 0xff : 0x00;
+            else
+                dst[x] = src[x];
+        }
+    }
+}
+
+/* Composites a cell of the atlas with its top left corner at 'x', 'y' */
+static void render_blit(struct render *render,
+                        const uint8_t *cell,
+                        int x,
+                        int y,
+                        uint32_t pixel)
+{
+    int x1 = MAX(x, 0), x2 = MIN(x + render->cell_width, render->width);
+    int y1 = MAX(y, 0), y2 = MIN(y + render->cell_height, render->height);
+
+    for (int i = y1; i < y2; ++i) {
+        const uint8_t *mask = cell + (i - y) * render->cell_width + (x1 - x);
+        uint32_t *dst = render->data + (size_t) i * render->stride + x1;
+
+        simd_over(dst, mask, x2 - x1, pixel);
+    }
+}
+
+void render_init(struct render *render)
+{
+    memset(render, 0, sizeof(*render));
+}
+
+void render_destroy(struct render *render)
+{
+    free(render->atlas);
+
+    if (render->font)
+        cairo_scaled_font_destroy(render->font);
+
+    if (render->surface)
+        cairo_surface_destroy(render->surface);
+}
+
+void render_set_font(struct render *render, cairo_scaled_font_t *font)
+{
+    int left = 0, right = 0, top = 0, bottom = 0;
+    FT_Face face;
+
+    TIMER_INIT_SIMPLE();
+
+    if (!render->enabled || render->font == font)
+        return;
+
+    /* Keep the font alive so it cannot be mistaken for a new one */
+    if (render->font)
+        cairo_scaled_font_destroy(render->font);
+
+    render->font = cairo_scaled_font_reference(font);
+
+    /* Without an atlas, all text is drawn by cairo */
+    free(render->atlas);
+    render->atlas = NULL;
+
+    /* The face is set up with the size and transformation of the font */
+    face = cairo_ft_scaled_font_lock_face(font);
+    if (!face)
+        return;
+
+    /* Find the box enclosing all glyphs relative to the pen position */
+    for (int c = RENDER_FIRST_CHAR; c <= RENDER_LAST_CHAR; ++c) {
+        FT_GlyphSlot slot = face->glyph;
+
+        if (render_load_glyph(face, c) < 0)
+            goto out;
+
+        left = MIN(left, slot->bitmap_left);
+        right = MAX(right, slot->bitmap_left + (int) slot->bitmap.width);
+        top = MAX(top, slot->bitmap_top);
+        bottom = MAX(bottom, (int) slot->bitmap.rows - slot->bitmap_top);
+
+        render->advances[c - RENDER_FIRST_CHAR] = slot->advance.x;
+    }
+
+    render->origin_x = -left;
+    render->origin_y = top;
+    render->cell_width = right - left;
+    render->cell_height = top + bottom;
+
+    render->atlas = xcalloc(RENDER_GLYPHS,
+                            (size_t) MAX(render->cell_width, 1) *
+                                (size_t) MAX(render->cell_height, 1));
+
+    for (int c = RENDER_FIRST_CHAR; c <= RENDER_LAST_CHAR; ++c) {
+        if (render_load_glyph(face, c) < 0) {
+            free(render->atlas);
+            render->atlas = NULL;
+            goto out;
+        }
+
+        render_copy_glyph(render, face->glyph, c);
+    }
+
+out:
+    cairo_ft_scaled_font_unlock_face(font);
+}
+
+void render_set_surface(struct render *render, cairo_surface_t *surface)
+{
+    cairo_format_t format;
+
+    if (render->surface)
+        cairo_surface_destroy(render->surface);
+
+    render->surface = NULL;
+    render->data = NULL;
+
+    if (cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE)
+        return;
+
+    /* Both formats store a pixel in a 32 bit value */
+    format = cairo_image_surface_get_format(surface);
+    if (format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24)
+        return;
+
+    render->surface = cairo_surface_reference(surface);
+    render->data = (uint32_t *) cairo_image_surface_get_data(surface);
+    render->width = cairo_image_surface_get_width(surface);
+    render->height = cairo_image_surface_get_height(surface);
+    render->stride = cairo_image_surface_get_stride(surface) / 4;
+}
+
+void render_fill(struct render *render,
+                 int x,
+                 int y,
+                 int width,
+                 int height,
+                 const struct color *color)
+{
+    uint32_t pixel = render_pixel(color);
+    int x1 = MAX(x, 0), x2 = MIN(x + width, render->width);
+    int y1 = MAX(y, 0), y2 = MIN(y + height, render->height);
+
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    cairo_surface_flush(render->surface);
+
+    for (int i = y1; i < y2; ++i) {
+        uint32_t *dst = render->data + (size_t) i * render->stride;
+
+        if (pixel >> 24 != 0xff) {
+            simd_over(dst + x1, NULL, x2 - x1, pixel);
+            continue;
+        }
+
+        for (int j = x1; j < x2; ++j)
+            dst[j] = pixel;
+    }
+
+    cairo_surface_mark_dirty_rectangle(render->surface,
+                                       x1,
+                                       y1,
+                                       x2 - x1,
+                                       y2 - y1);
+}
+
+int render_text_width(const struct render *render, const char *str, int len)
+{
+    long width = 0;
+
+    for (int i = 0; i < len; ++i) {
+        if (str[i] >= RENDER_FIRST_CHAR && str[i] <= RENDER_LAST_CHAR)
+            width += render->advances[str[i] - RENDER_FIRST_CHAR];
+    }
+
+    return (int) ((width + 32) >> 6);
+}
+
+bool render_text(struct render *render,
+                 int x,
+                 int y,
+                 const char *str,
+                 int len,
+                 const struct color *color)
+{
+    return render_text_marked(render, x, y, str, len, color, NULL, 0, NULL);
+}
+
+bool render_text_marked(struct render *render,
+                        int x,
+                        int y,
+                        const char *str,
+                        int len,
+                        const struct color *color,
+                        const struct span *spans,
+                        int n_spans,
+                        const struct color *mark)
+{
+    size_t size = (size_t) (render->cell_width * render->cell_height);
+    uint32_t pixel = render_pixel(color);
+    uint32_t marked = (n_spans) ? render_pixel(mark) : pixel;
+    long pen = (long) x << 6;
+    int top = y - render->origin_y;
+    int x1, y1, x2, y2, k = 0;
+
+    if (!render_supports(str, len))
+        return false;
+
+    cairo_surface_flush(render->surface);
+
+    /* Glyphs are placed at the pixel closest to the exact pen position */
+    for (int i = 0; i < len; ++i) {
+        int c = str[i] - RENDER_FIRST_CHAR;
+        int gx = (int) ((pen + 32) >> 6) - render->origin_x;
+        uint32_t p = pixel;
+
+        while (k < n_spans && spans[k].end <= i)
+            ++k;
+
+        if (k < n_spans && spans[k].begin <= i)
+            p = marked;
+
+        render_blit(render, render->atlas + (size_t) c * size, gx, top, p);
+
+        pen += render->advances[c];
+    }
+
+    x1 = MAX(x - render->origin_x, 0);
+    y1 = MAX(top, 0);
+    x2 = MIN((int) ((pen + 32) >> 6) + render->cell_width, render->width);
+    y2 = MIN(top + render->cell_height, render->height);
+
+    if (x1 < x2 && y1 < y2)
+        cairo_surface_mark_dirty_rectangle(render->surface,
+                                           x1,
+                                           y1,
+                                           x2 - x1,
+                                           y2 - y1);
+
+    return true;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cairo.h>
+
+#include "widget-common.h"
+
+/* Glyphs of the printable ASCII characters are kept in the atlas */
+#define RENDER_FIRST_CHAR ' '
+#define RENDER_LAST_CHAR '~'
+#define RENDER_GLYPHS (RENDER_LAST_CHAR - RENDER_FIRST_CHAR + 1)
+
+/*
+ * Draws solid rectangles and text straight into the pixels of an image
+ * surface. The glyphs are rasterized once into an atlas of equally sized
+ * cells, so drawing text only composites coverage values onto the target
+ * row by row. Everything the renderer cannot handle, e.g. surfaces
+ * without accessible pixels or characters outside of the atlas, has to
+ * be drawn with cairo instead.
+ */
+struct render {
+    cairo_surface_t *surface;
+    uint32_t *data;
+    int width;
+    int height;
+    int stride;
+
+    cairo_scaled_font_t *font;
+    uint8_t *atlas;
+    int cell_width;
+    int cell_height;
+
+    /* Position of the pen relative to the top left corner of a cell */
+    int origin_x;
+    int origin_y;
+
+    /* Advance widths in 26.6 fixed point format as used by FreeType */
+    long advances[RENDER_GLYPHS];
+
+    bool enabled;
+};
+
+void render_init(struct render *render);
+
+void render_destroy(struct render *render);
+
+static inline void render_set_enabled(struct render *render, bool enabled)
+{
+    render->enabled = enabled;
+}
+
+/* Rasterizes the glyphs of 'font' unless this was done before */
+void render_set_font(struct render *render, cairo_scaled_font_t *font);
+
+/* Targets 'surface' if its pixels are accessible */
+void render_set_surface(struct render *render, cairo_surface_t *surface);
+
+static inline bool render_active(const struct render *render)
+{
+    return render->enabled && render->data && render->atlas;
+}
+
+static inline bool render_supports(const char *str, int len)
+{
+    for (int i = 0; i < len; ++i) {
+        if (str[i] < RENDER_FIRST_CHAR || str[i] > RENDER_LAST_CHAR)
+            return false;
+    }
+
+    return true;
+}
+
+void render_fill(struct render *render,
+                 int x,
+                 int y,
+                 int width,
+                 int height,
+                 const struct color *color);
+
+/* Returns the width of 'str' in pixels */
+int render_text_width(const struct render *render, const char *str, int len);
+
+/*
+ * Draws 'str' with the pen starting at 'x' on the baseline 'y'. Returns
+ * false without drawing anything if a character is missing from the
+ * atlas.
+ */
+bool render_text(struct render *render,
+                 int x,
+                 int y,
+                 const char *str,
+                 int len,
+                 const struct color *color);
+
+/*
+ * Like render_text(), but draws the characters within the 'n_spans'
+ * ordered, disjoint 'spans' with 'mark' instead.
+ */
+bool render_text_marked(struct render *render,
+                        int x,
+                        int y,
+                        const char *str,
+                        int len,
+                        const struct color *color,
+                        const struct span *spans,
+                        int n_spans,
+                        const struct color *mark);
+
+#endif /* RENDER_H_ */
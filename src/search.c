@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "search.h"
+#include "timer.h"
+
+#include "util/die.h"
+#include "util/errstr.h"
+#include "util/io-util.h"
+#include "util/macro.h"
+#include "util/xalloc.h"
+
+/*
+ * Copies the offsets of the matching items only. There are fewer of them
+ * with every character appended to the lookup string.
+ */
+static void search_result_copy_offsets(struct search_result *res,
+                                       const struct item_list *list)
+{
+    const uint32_t *offsets = item_list_offsets(list);
+    const uint64_t *set = item_list_matches(list);
+    size_t n_words = bitset_words((size_t) item_list_size(list));
+    int count = item_list_match_count(list), n = 0;
+
+    res->has_offsets = offsets != NULL;
+    if (!offsets)
+        return;
+
+    if (count > res->offsets_max) {
+        res->offsets_max = count;
+        res->offsets = xrealloc(res->offsets,
+                                count * sizeof(*res->offsets));
+    }
+
+    for (size_t i = 0; i < n_words; ++i) {
+        for (uint64_t bits = set[i]; bits; bits &= bits - 1)
+            res->offsets[n++] = offsets[i * 64 + __builtin_ctzll(bits)];
+    }
+}
+
+static void search_result_copy(struct search_result *res,
+                               const struct item_list *list,
+                               unsigned int generation)
+{
+    size_t n_words = bitset_words((size_t) item_list_size(list));
+    const uint64_t *top = item_list_top(list);
+
+    if (n_words > res->size) {
+        res->set = xrealloc(res->set, n_words * sizeof(*res->set));
+        res->top = xrealloc(res->top, n_words * sizeof(*res->top));
+        res->size = n_words;
+    }
+
+    if (n_words)
+        memcpy(res->set, item_list_matches(list), n_words * sizeof(*res->set));
+
+    if (top)
+        memcpy(res->top, top, n_words * sizeof(*res->top));
+
+    res->n = item_list_size(list);
+    res->count = item_list_match_count(list);
+    res->n_top = item_list_top_count(list);
+    res->generation = generation;
+
+    res->len = item_list_lookup_len(list);
+    res->mode = item_list_mode(list);
+    memcpy(res->lookup, item_list_lookup(list), res->len);
+
+    search_result_copy_offsets(res, list);
+}
+
+/*
+ * Brings the lookup string of the item list in line with the requested
+ * one. Only the characters after their common prefix are looked up.
+ */
+static int
+search_apply(struct search *search, const char *lookup, int len, int mode)
+{
+    struct item_list *list = search->list;
+    const char *str;
+    int n = 0, err;
+
+    if (item_list_stale(list) || item_list_mode(list) != mode) {
+        item_list_lookup_clear(list);
+        item_list_set_mode(list, mode);
+    }
+
+    str = item_list_lookup(list);
+
+    while (n < len && n < item_list_lookup_len(list) && str[n] == lookup[n])
+        ++n;
+
+    while (item_list_lookup_len(list) > n) {
+        err = item_list_lookup_pop_back(list);
+        if (err < 0)
+            return err;
+    }
+
+    return item_list_lookup_push_str(list, lookup + n, len - n);
+}
+
+static void search_publish(struct search *search, unsigned int generation)
+{
+    uint64_t value = 1;
+    ssize_t n;
+
+    search_result_copy(&search->results[search->back],
+                       search->list,
+                       generation);
+
+    search->back = atomic_exchange(&search->ready,
+                                   search->back | SEARCH_RESULT_FRESH);
+    search->back &= ~SEARCH_RESULT_FRESH;
+
+    /* The counter cannot overflow as it is reset by every read */
+    do {
+        n = write(search->event_fd, &value, sizeof(value));
+    } while (n < 0 && errno == EINTR);
+
+    if (unlikely(n < 0))
+        die("failed to signal search result: %s\n", errstr(errno));
+}
+
+static void *search_run(void *arg)
+{
+    struct search *search = arg;
+
+    while (true) {
+        char lookup[ARRAY_SIZE(search->lookup)];
+        unsigned int generation;
+        int len, mode, err;
+        bool complete;
+
+        pthread_mutex_lock(&search->mutex);
+
+        while (search->done == search->generation && !search->quit)
+            pthread_cond_wait(&search->cond, &search->mutex);
+
+        if (search->quit) {
+            pthread_mutex_unlock(&search->mutex);
+            break;
+        }
+
+        memcpy(lookup, search->lookup, sizeof(lookup));
+        len = search->len;
+        mode = search->mode;
+        generation = search->generation;
+
+        search->done = generation;
+        atomic_store(&search->cancel, false);
+
+        pthread_mutex_unlock(&search->mutex);
+
+        err = search_apply(search, lookup, len, mode);
+        if (!err)
+            err = item_list_rank(search->list);
+
+        if (err < 0)
+            continue;
+
+        /*
+         * Once the input is complete, the list is left to this thread.
+         * This has to be checked before the result is published, as
+         * the list may be extended as soon as the search is idle.
+         */
+        complete = item_list_stream_fd(search->list) < 0;
+
+        search_publish(search, generation);
+
+        /* Use the time until the next keystroke to look ahead */
+        if (complete)
+            (void) item_list_speculate(search->list);
+    }
+
+    return NULL;
+}
+
+/* Starts a new generation, the caller has to hold the mutex */
+static void search_submit(struct search *search)
+{
+    ++search->generation;
+    atomic_store(&search->cancel, true);
+
+    pthread_cond_signal(&search->cond);
+}
+
+void search_init(struct search *search, struct item_list *list)
+{
+    int err;
+
+    TIMER_INIT_SIMPLE();
+
+    memset(search, 0, sizeof(*search));
+
+    search->list = list;
+    search->mode = item_list_mode(list);
+
+    /* Start out with the lookup string the list was prepared with */
+    search->len = item_list_lookup_len(list);
+    memcpy(search->lookup, item_list_lookup(list), search->len);
+    search->front = 0;
+    search->back = 1;
+    atomic_init(&search->ready, 2);
+    atomic_init(&search->cancel, false);
+
+    search->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (unlikely(search->event_fd < 0))
+        die("failed to create search event: %s\n", errstr(errno));
+
+    pthread_mutex_init(&search->mutex, NULL);
+    pthread_cond_init(&search->cond, NULL);
+
+    item_list_set_cancel(list, &search->cancel);
+
+    /* The worker has not started yet, so the list can be read directly */
+    search_sync(search);
+
+    err = pthread_create(&search->thread, NULL, &search_run, search);
+    if (unlikely(err))
+        die("failed to create search thread: %s\n", errstr(err));
+}
+
+void search_destroy(struct search *search)
+{
+#ifdef MEM_NOLEAK
+    pthread_mutex_lock(&search->mutex);
+
+    search->quit = true;
+    atomic_store(&search->cancel, true);
+
+    pthread_cond_signal(&search->cond);
+    pthread_mutex_unlock(&search->mutex);
+
+    (void) pthread_join(search->thread, NULL);
+
+    item_list_set_cancel(search->list, NULL);
+
+    for (int i = 0; i < ARRAY_SIZE(search->results); ++i) {
+        free(search->results[i].set);
+        free(search->results[i].top);
+        free(search->results[i].offsets);
+    }
+
+    pthread_cond_destroy(&search->cond);
+    pthread_mutex_destroy(&search->mutex);
+    close(search->event_fd);
+#else
+    (void) search;
+#endif
+}
+
+void search_set_mode(struct search *search, int mode)
+{
+    if (search->mode == mode)
+        return;
+
+    pthread_mutex_lock(&search->mutex);
+
+    search->mode = mode;
+
+    search_submit(search);
+
+    pthread_mutex_unlock(&search->mutex);
+}
+
+void search_push_back(struct search *search, int c)
+{
+    if (search->len >= ARRAY_SIZE(search->lookup) - 1 || !isascii(c))
+        return;
+
+    pthread_mutex_lock(&search->mutex);
+
+    search->lookup[search->len++] = (char) c;
+
+    search_submit(search);
+
+    pthread_mutex_unlock(&search->mutex);
+}
+
+void search_push_str(struct search *search, const char *str, int len)
+{
+    int n = search->len;
+
+    pthread_mutex_lock(&search->mutex);
+
+    for (int i = 0; i < len && n < ARRAY_SIZE(search->lookup) - 1; ++i) {
+        if (isascii(str[i]))
+            search->lookup[n++] = str[i];
+    }
+
+    if (n != search->len) {
+        search->len = n;
+        search_submit(search);
+    }
+
+    pthread_mutex_unlock(&search->mutex);
+}
+
+void search_pop_back(struct search *search)
+{
+    if (!search->len)
+        return;
+
+    pthread_mutex_lock(&search->mutex);
+
+    search->lookup[--search->len] = '\0';
+
+    search_submit(search);
+
+    pthread_mutex_unlock(&search->mutex);
+}
+
+void search_clear(struct search *search)
+{
+    if (!search->len)
+        return;
+
+    pthread_mutex_lock(&search->mutex);
+
+    memset(search->lookup, 0, sizeof(search->lookup));
+    search->len = 0;
+
+    search_submit(search);
+
+    pthread_mutex_unlock(&search->mutex);
+}
+
+bool search_update(struct search *search)
+{
+    uint64_t value;
+    int front;
+
+    /* Reset the event counter, it is only used for waking up */
+    (void) io_util_read(search->event_fd, &value, sizeof(value));
+
+    if (!(atomic_load(&search->ready) & SEARCH_RESULT_FRESH))
+        return false;
+
+    front = atomic_exchange(&search->ready, search->front);
+    search->front = front & ~SEARCH_RESULT_FRESH;
+
+    return true;
+}
+
+void search_sync(struct search *search)
+{
+    /* The search is idle, so the ranking cannot be cancelled */
+    (void) item_list_rank(search->list);
+
+    search_result_copy(&search->results[search->front],
+                       search->list,
+                       search->generation);
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCH_H_
+#define SEARCH_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "item-list.h"
+
+#include "util/bitset.h"
+
+/* Set in 'search->ready' if the slot it refers to holds a new result */
+#define SEARCH_RESULT_FRESH 0x04
+
+/*
+ * Matching items of a completed lookup. The 'n_top' items in 'top' are
+ * shown before all other matching items. 'lookup' holds the lookup
+ * string the items were matched against in 'mode'.
+ *
+ * If 'has_offsets' is set, 'offsets' holds the first match of the last
+ * term in the name of each matching item, ordered like the items.
+ */
+struct search_result {
+    uint64_t *set;
+    uint64_t *top;
+    size_t size;
+    int n;
+    int count;
+    int n_top;
+    unsigned int generation;
+    char lookup[64];
+    int len;
+    int mode;
+
+    uint32_t *offsets;
+    int offsets_max;
+    bool has_offsets;
+};
+
+/*
+ * Runs the lookups on an item list in a separate thread, so the user
+ * interface never waits for a lookup to finish.
+ *
+ * Every change of the lookup string starts a new generation and cancels
+ * the lookup in progress. Completed results are passed to the user
+ * interface through three result slots: the worker fills its back slot
+ * and swaps it with the 'ready' slot, the user interface swaps its front
+ * slot with the 'ready' slot if the latter is fresh. Neither side ever
+ * waits for the other one. The worker signals new results on 'event_fd'.
+ *
+ * The user interface must not modify the item list unless the search is
+ * idle, i.e. the result of the latest generation is shown.
+ */
+struct search {
+    struct item_list *list;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    /* Latest request, only modified by the user interface */
+    char lookup[64];
+    int len;
+    int mode;
+    unsigned int generation;
+    bool quit;
+
+    /* Generation picked up by the worker, guarded by 'mutex' */
+    unsigned int done;
+
+    atomic_bool cancel;
+
+    struct search_result results[3];
+    atomic_int ready;
+    int front;
+    int back;
+
+    int event_fd;
+};
+
+void search_init(struct search *search, struct item_list *list);
+
+void search_destroy(struct search *search);
+
+static inline int search_fd(const struct search *search)
+{
+    return search->event_fd;
+}
+
+static inline int search_mode(const struct search *search)
+{
+    return search->mode;
+}
+
+/*
+ * Returns the lookup string of the shown result, which lags behind the
+ * latest one until the search is idle.
+ */
+static inline const char *search_lookup(const struct search *search)
+{
+    return search->results[search->front].lookup;
+}
+
+static inline int search_lookup_len(const struct search *search)
+{
+    return search->results[search->front].len;
+}
+
+static inline int search_lookup_mode(const struct search *search)
+{
+    return search->results[search->front].mode;
+}
+
+static inline bool search_idle(const struct search *search)
+{
+    return search->results[search->front].generation == search->generation;
+}
+
+void search_set_mode(struct search *search, int mode);
+
+void search_push_back(struct search *search, int c);
+
+/* Appends all of 'str' as a single change of the lookup string */
+void search_push_str(struct search *search, const char *str, int len);
+
+void search_pop_back(struct search *search);
+
+void search_clear(struct search *search);
+
+/*
+ * Picks up the latest result published by the worker. Returns true if
+ * the shown result changed.
+ */
+bool search_update(struct search *search);
+
+/*
+ * Shows the match state of the item list after it was modified by the
+ * user interface. Must only be called if the search is idle.
+ */
+void search_sync(struct search *search);
+
+static inline int search_count(const struct search *search)
+{
+    return search->results[search->front].count;
+}
+
+static inline bool search_match(const struct search *search, int index)
+{
+    const struct search_result *res = &search->results[search->front];
+
+    return index < res->n && bitset_test(res->set, (size_t) index);
+}
+
+/*
+ * Returns where the last term of the lookup string was first found in
+ * the name of a matching item or -1 if this was not recorded.
+ */
+static inline long search_offset(const struct search *search, int index)
+{
+    const struct search_result *res = &search->results[search->front];
+    size_t k = (size_t) index / 64;
+    uint64_t mask = ((uint64_t) 1 << (index % 64)) - 1;
+    size_t rank;
+
+    if (!res->has_offsets || !search_match(search, index))
+        return -1;
+
+    rank = bitset_count(res->set, k);
+    rank += (size_t) __builtin_popcountll(res->set[k] & mask);
+
+    return (long) res->offsets[rank];
+}
+
+static inline bool search_top(const struct search *search, int index)
+{
+    const struct search_result *res = &search->results[search->front];
+
+    return res->n_top && bitset_test(res->top, (size_t) index);
+}
+
+/* Returns the k-th matching item in the shown order or -1 */
+static inline int search_select(const struct search *search, int k)
+{
+    const struct search_result *res = &search->results[search->front];
+    size_t n = (size_t) res->n;
+
+    if (k < 0)
+        return -1;
+
+    if (k < res->n_top)
+        return (int) bitset_select(res->top, n, (size_t) k);
+
+    if (!res->n_top)
+        return (int) bitset_select(res->set, n, (size_t) k);
+
+    k -= res->n_top;
+
+    return (int) bitset_select_andnot(res->set, res->top, n, (size_t) k);
+}
+
+/* Returns the matching item shown after 'index' or -1 */
+static inline int search_next(const struct search *search, int index)
+{
+    const struct search_result *res = &search->results[search->front];
+    size_t n = (size_t) res->n;
+    long i;
+
+    if (search_top(search, index)) {
+        i = bitset_next(res->top, n, (size_t) index + 1);
+
+        return (i >= 0) ? (int) i : search_select(search, res->n_top);
+    }
+
+    i = bitset_next(res->set, n, (size_t) index + 1);
+
+    while (i >= 0 && search_top(search, (int) i))
+        i = bitset_next(res->set, n, (size_t) i + 1);
+
+    return (int) i;
+}
+
+/* Returns the position of a matching item in the shown order */
+static inline int search_rank(const struct search *search, int index)
+{
+    const struct search_result *res = &search->results[search->front];
+    size_t k = (size_t) index / 64;
+    uint64_t mask = ((uint64_t) 1 << (index % 64)) - 1;
+    int rank = 0;
+
+    if (search_top(search, index)) {
+        for (size_t i = 0; i < k; ++i)
+            rank += __builtin_popcountll(res->top[i]);
+
+        return rank + __builtin_popcountll(res->top[k] & mask);
+    }
+
+    for (size_t i = 0; i < k; ++i) {
+        uint64_t word = res->set[i];
+
+        if (res->n_top)
+            word &= ~res->top[i];
+
+        rank += __builtin_popcountll(word);
+    }
+
+    if (res->n_top)
+        mask &= ~res->top[k];
+
+    return res->n_top + rank + __builtin_popcountll(res->set[k] & mask);
+}
+
+#endif /* SEARCH_H_ */
@@ -78,12 +78,17 @@ static inline void timer_destroy(const struct timer *timer)
 #define TIMER_INIT_SIMPLE() TIMER_INIT(__func__, CLOCK_MONOTONIC)
 //#define TIMER_INIT_SIMPLE() TIMER_INIT(__func__, CLOCK_PROCESS_CPUTIME_ID)
 
+/* Reports a decision made by the timed code, e.g. along with its cost */
+#define TIMER_NOTE(...) fprintf(stderr, __VA_ARGS__)
+
 #else
 
 #define TIMER_INIT(name_, clock_) while (0)
 
 #define TIMER_INIT_SIMPLE() while (0)
 
+#define TIMER_NOTE(...) while (0)
+
 #endif
 
 #endif /* TIMER_H_ */
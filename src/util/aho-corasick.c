@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "aho-corasick.h"
+
+void aho_corasick_init(struct aho_corasick *ac)
+{
+    memset(ac->next, 0, sizeof(ac->next));
+
+    ac->link[0] = 0;
+    ac->n_states = 1;
+}
+
+int aho_corasick_add(struct aho_corasick *ac,
+                     const char *str,
+                     size_t len,
+                     uint8_t *states)
+{
+    int q = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char) str[i];
+
+        /* State 0 is the root which is never the target of the trie */
+        if (!ac->next[q][c]) {
+            if (ac->n_states >= AHO_CORASICK_MAX_STATES)
+                return -ENOSPC;
+
+            ac->next[q][c] = (uint8_t) ac->n_states++;
+        }
+
+        q = ac->next[q][c];
+        states[i] = (uint8_t) q;
+    }
+
+    return 0;
+}
+
+void aho_corasick_build(struct aho_corasick *ac)
+{
+    uint8_t queue[AHO_CORASICK_MAX_STATES];
+    int head = 0, tail = 0;
+
+    /* The longest proper suffix of all states at depth 1 is the root */
+    for (int c = 0; c < 256; ++c) {
+        int v = ac->next[0][c];
+
+        if (v) {
+            ac->link[v] = 0;
+            queue[tail++] = (uint8_t) v;
+        }
+    }
+
+    /*
+     * Visit the trie in breadth-first order. When a state is visited, its
+     * row only contains trie edges, and the rows of all states with a
+     * smaller depth, including its suffix link, are already complete.
+     * Missing edges are completed by following the suffix link.
+     */
+    while (head < tail) {
+        int u = queue[head++];
+        int link = ac->link[u];
+
+        for (int c = 0; c < 256; ++c) {
+            int v = ac->next[u][c];
+
+            if (v) {
+                ac->link[v] = ac->next[link][c];
+                queue[tail++] = (uint8_t) v;
+            } else {
+                ac->next[u][c] = ac->next[link][c];
+            }
+        }
+    }
+}
+
+uint64_t
+aho_corasick_scan(const struct aho_corasick *ac, const char *str, size_t len)
+{
+    uint64_t seen = 1, full;
+    int q = 0;
+
+    full = (ac->n_states < 64) ? ((uint64_t) 1 << ac->n_states) - 1 : ~0ull;
+
+    for (size_t i = 0; i < len && seen != full; ++i) {
+        q = ac->next[q][(unsigned char) str[i]];
+
+        /*
+         * All suffixes of the current state which are states themselves
+         * occur here as well. Once a state is marked, so are all states
+         * along its suffix links.
+         */
+        for (int v = q; !(seen & ((uint64_t) 1 << v)); v = ac->link[v])
+            seen |= (uint64_t) 1 << v;
+    }
+
+    return seen;
+}
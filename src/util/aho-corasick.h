@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AHO_CORASICK_H_
+#define AHO_CORASICK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AHO_CORASICK_MAX_STATES 64
+
+/*
+ * Aho-Corasick automaton for a small set of patterns. The states are the
+ * nodes of the trie of all patterns, i.e. every prefix of every pattern
+ * has its own state. Scanning a string yields the set of all states whose
+ * prefix occurs somewhere within the string.
+ */
+struct aho_corasick {
+    uint8_t next[AHO_CORASICK_MAX_STATES][256];
+    uint8_t link[AHO_CORASICK_MAX_STATES];
+    int n_states;
+};
+
+void aho_corasick_init(struct aho_corasick *ac);
+
+/*
+ * Adds a pattern to the automaton and stores the state reached after
+ * each of its characters in 'states'. Returns -ENOSPC if the automaton
+ * runs out of states.
+ */
+int aho_corasick_add(struct aho_corasick *ac,
+                     const char *str,
+                     size_t len,
+                     uint8_t *states);
+
+void aho_corasick_build(struct aho_corasick *ac);
+
+/* Returns a bit mask with a set bit for every state found in 'str' */
+uint64_t
+aho_corasick_scan(const struct aho_corasick *ac, const char *str, size_t len);
+
+#endif /* AHO_CORASICK_H_ */
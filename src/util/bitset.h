@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITSET_H_
+#define BITSET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of 64 bit words needed to hold 'n' bits */
+static inline size_t bitset_words(size_t n)
+{
+    return (n + 63) / 64;
+}
+
+static inline bool bitset_test(const uint64_t *set, size_t i)
+{
+    return (set[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void bitset_set(uint64_t *set, size_t i)
+{
+    set[i / 64] |= (uint64_t) 1 << (i % 64);
+}
+
+static inline size_t bitset_count(const uint64_t *set, size_t n_words)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < n_words; ++i)
+        count += (size_t) __builtin_popcountll(set[i]);
+
+    return count;
+}
+
+/*
+ * Returns the index of the first set bit at or after position 'i' or
+ * -1 if there is none within the first 'n' bits.
+ */
+static inline long bitset_next(const uint64_t *set, size_t n, size_t i)
+{
+    size_t n_words = bitset_words(n);
+    size_t k = i / 64;
+    uint64_t word;
+
+    if (i >= n)
+        return -1;
+
+    word = set[k] & (~(uint64_t) 0 << (i % 64));
+
+    while (!word) {
+        if (++k >= n_words)
+            return -1;
+
+        word = set[k];
+    }
+
+    i = k * 64 + (size_t) __builtin_ctzll(word);
+
+    return (i < n) ? (long) i : -1;
+}
+
+/*
+ * Returns the index of the k-th set bit, counting from zero, or -1 if
+ * less than k + 1 bits are set within the first 'n' bits.
+ */
+static inline long bitset_select(const uint64_t *set, size_t n, size_t k)
+{
+    size_t n_words = bitset_words(n);
+
+    for (size_t i = 0; i < n_words; ++i) {
+        uint64_t word = set[i];
+        size_t count = (size_t) __builtin_popcountll(word);
+
+        if (k >= count) {
+            k -= count;
+            continue;
+        }
+
+        /* Drop the lowest set bits until the k-th one is the lowest */
+        while (k--)
+            word &= word - 1;
+
+        i = i * 64 + (size_t) __builtin_ctzll(word);
+
+        return (i < n) ? (long) i : -1;
+    }
+
+    return -1;
+}
+
+/* Like bitset_select() for the bits set in 'set' but not in 'mask' */
+static inline long bitset_select_andnot(const uint64_t *set,
+                                        const uint64_t *mask,
+                                        size_t n,
+                                        size_t k)
+{
+    size_t n_words = bitset_words(n);
+
+    for (size_t i = 0; i < n_words; ++i) {
+        uint64_t word = set[i] & ~mask[i];
+        size_t count = (size_t) __builtin_popcountll(word);
+
+        if (k >= count) {
+            k -= count;
+            continue;
+        }
+
+        while (k--)
+            word &= word - 1;
+
+        i = i * 64 + (size_t) __builtin_ctzll(word);
+
+        return (i < n) ? (long) i : -1;
+    }
+
+    return -1;
+}
+
+#endif /* BITSET_H_ */
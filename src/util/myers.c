@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "myers.h"
+
+void myers_init(struct myers *myers, const char *pattern, size_t len)
+{
+    memset(myers->peq, 0, sizeof(myers->peq));
+
+    if (len > MYERS_MAX_LEN)
+        len = MYERS_MAX_LEN;
+
+    /* Bit 'i' of each entry is set if the pattern has that byte at 'i' */
+    for (size_t i = 0; i < len; ++i)
+        myers->peq[(unsigned char) pattern[i]] |= (uint64_t) 1 << i;
+
+    myers->last = (len) ? (uint64_t) 1 << (len - 1) : 0;
+    myers->len = (int) len;
+}
+
+bool myers_match(const struct myers *myers,
+                 const char *str,
+                 size_t len,
+                 int k)
+{
+    uint64_t pv = ~0ull, mv = 0;
+    int score = myers->len;
+
+    if (score <= k)
+        return true;
+
+    for (size_t i = 0; i < len; ++i) {
+        uint64_t eq = myers->peq[(unsigned char) str[i]];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+
+        if (ph & myers->last)
+            ++score;
+        else if (mh & myers->last)
+            --score;
+
+        /*
+         * A match may start anywhere in the string, so the distance in
+         * the row of the empty pattern prefix stays zero and no
+         * horizontal delta is shifted in.
+         */
+        ph <<= 1;
+        mh <<= 1;
+
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        if (score <= k)
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MYERS_H_
+#define MYERS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MYERS_MAX_LEN 64
+
+/*
+ * Myers' bit-parallel algorithm for approximate string matching. The
+ * edit distances between the pattern and the best matching substring
+ * ending at each position of a string are kept as bit vectors of
+ * vertical deltas, so each character of the string costs a handful of
+ * word operations regardless of the number of allowed errors.
+ */
+struct myers {
+    uint64_t peq[256];
+    uint64_t last;
+    int len;
+};
+
+/* Prepares the matcher for a pattern of at most MYERS_MAX_LEN bytes */
+void myers_init(struct myers *myers, const char *pattern, size_t len);
+
+/*
+ * Returns true if a substring of 'str' can be turned into the pattern
+ * with at most 'k' insertions, deletions and substitutions.
+ */
+bool myers_match(const struct myers *myers,
+                 const char *str,
+                 size_t len,
+                 int k);
+
+#endif /* MYERS_H_ */
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+
+static inline void simd_classify32(const char *p, uint32_t *nl, uint32_t *ws)
+{
+    __m256i v, t, r, s, l;
+
+    v = _mm256_loadu_si256((const __m256i *) p);
+
+    /* '\t', '\n', '\v', '\f' and '\r' form a contiguous range */
+    t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+    r = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t);
+    s = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    l = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+
+    *nl = (uint32_t) _mm256_movemask_epi8(l);
+    *ws = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(r, s));
+}
+
+#elif defined(__SSE2__)
+
+static inline void simd_classify16(const char *p, uint32_t *nl, uint32_t *ws)
+{
+    __m128i v, t, r, s, l;
+
+    v = _mm_loadu_si128((const __m128i *) p);
+
+    /* '\t', '\n', '\v', '\f' and '\r' form a contiguous range */
+    t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    r = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+    s = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    l = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+
+    *nl = (uint32_t) _mm_movemask_epi8(l);
+    *ws = (uint32_t) _mm_movemask_epi8(_mm_or_si128(r, s));
+}
+
+#endif
+
+/*
+ * Classify the 64 bytes starting at 'p'. Bit 'i' of 'nl' is set if 'p[i]'
+ * is a newline character, bit 'i' of 'ws' is set if 'p[i]' is a whitespace
+ * character as defined by isspace() in the "C" locale.
+ */
+static inline void simd_classify64(const char *p, uint64_t *nl, uint64_t *ws)
+{
+#if defined(__AVX2__)
+    uint32_t nl0, ws0, nl1, ws1;
+
+    simd_classify32(p, &nl0, &ws0);
+    simd_classify32(p + 32, &nl1, &ws1);
+
+    *nl = (uint64_t) nl1 << 32 | nl0;
+    *ws = (uint64_t) ws1 << 32 | ws0;
+#elif defined(__SSE2__)
+    uint64_t n = 0, w = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        uint32_t x, y;
+
+        simd_classify16(p + 16 * i, &x, &y);
+
+        n |= (uint64_t) x << (16 * i);
+        w |= (uint64_t) y << (16 * i);
+    }
+
+    *nl = n;
+    *ws = w;
+#else
+    uint64_t n = 0, w = 0;
+
+    for (int i = 0; i < 64; ++i) {
+        unsigned char c = (unsigned char) p[i];
+
+        n |= (uint64_t) (c == '\n') << i;
+        w |= (uint64_t) (c == ' ' || (unsigned char) (c - '\t') <= 4) << i;
+    }
+
+    *nl = n;
+    *ws = w;
+#endif
+}
+
+/* Multiplies each channel of 'x' by 'a' / 255 */
+static inline uint32_t simd_mul_un8x4(uint32_t x, uint32_t a)
+{
+    uint32_t rb = (x & 0x00ff00ff) * a + 0x00800080;
+    uint32_t ag = ((x >> 8) & 0x00ff00ff) * a + 0x00800080;
+
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+    return rb | ag;
+}
+
+#if defined(__SSE2__)
+
+/* Multiplies the 16 bit lanes of 'x' and 'y', both at most 255, / 255 */
+static inline __m128i simd_mul_un8x8(__m128i x, __m128i y)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, y), _mm_set1_epi16(0x80));
+
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/* Composites two premultiplied pixels in 16 bit lanes over 'dst' */
+static inline __m128i simd_over_un8x8(__m128i src, __m128i dst)
+{
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xff), 0xff);
+
+    a = _mm_sub_epi16(_mm_set1_epi16(0xff), a);
+
+    return _mm_add_epi16(src, simd_mul_un8x8(dst, a));
+}
+
+#endif
+
+/*
+ * Composites 'color', a premultiplied ARGB value, over the 'n' pixels at
+ * 'dst'. If 'mask' is not NULL, the color is scaled by its coverage
+ * values first, e.g. to draw a row of a glyph.
+ */
+static inline void
+simd_over(uint32_t *dst, const uint8_t *mask, int n, uint32_t color)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i src = _mm_unpacklo_epi8(_mm_set1_epi32((int) color), zero);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i d, lo, hi, slo = src, shi = src;
+
+        if (mask) {
+            uint32_t m4;
+            __m128i m;
+
+            memcpy(&m4, mask + i, sizeof(m4));
+
+            /* Nothing to do in between the strokes of a glyph */
+            if (!m4)
+                continue;
+
+            /* Spread each coverage value over the channels of its pixel */
+            m = _mm_cvtsi32_si128((int) m4);
+            m = _mm_unpacklo_epi8(m, m);
+            m = _mm_unpacklo_epi16(m, m);
+
+            slo = simd_mul_un8x8(src, _mm_unpacklo_epi8(m, zero));
+            shi = simd_mul_un8x8(src, _mm_unpackhi_epi8(m, zero));
+        }
+
+        d = _mm_loadu_si128((const __m128i *) (dst + i));
+
+        lo = simd_over_un8x8(slo, _mm_unpacklo_epi8(d, zero));
+        hi = simd_over_un8x8(shi, _mm_unpackhi_epi8(d, zero));
+
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        uint32_t s = (mask) ? simd_mul_un8x4(color, mask[i]) : color;
+
+        dst[i] = s + simd_mul_un8x4(dst[i], 0xff - (s >> 24));
+    }
+}
+
+#endif /* SIMD_H_ */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "macro.h"
+#include "vmem.h"
+
+/* Regions are made accessible in steps of at least this many bytes. */
+#define VMEM_STEP ((size_t) 1 << 20)
+
+int vmem_init(struct vmem *mem, size_t max)
+{
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    void *base;
+
+    max = (max + VMEM_STEP - 1) & ~(VMEM_STEP - 1);
+
+    /*
+     * Reserving address space does not consume any memory. However, the
+     * address space itself might be limited, e.g. on 32-bit systems.
+     * In this case try again with a smaller region.
+     */
+    while (1) {
+        base = mmap(NULL, max, PROT_NONE, flags, -1, 0);
+        if (base != MAP_FAILED)
+            break;
+
+        if (errno != ENOMEM || max <= VMEM_STEP)
+            return -errno;
+
+        max /= 2;
+    }
+
+    mem->base = base;
+    mem->size = 0;
+    mem->max = max;
+
+    return 0;
+}
+
+void vmem_destroy(struct vmem *mem)
+{
+    if (mem->base)
+        (void) munmap(mem->base, mem->max);
+
+    mem->base = NULL;
+    mem->size = 0;
+    mem->max = 0;
+}
+
+int vmem_grow(struct vmem *mem, size_t size)
+{
+    const int prot = PROT_READ | PROT_WRITE;
+    size_t n;
+    int err;
+
+    if (size <= mem->size)
+        return 0;
+
+    if (unlikely(size > mem->max))
+        return -ENOMEM;
+
+    /* Grow geometrically to keep the number of system calls low */
+    n = MAX(size, 2 * mem->size);
+    n = (n + VMEM_STEP - 1) & ~(VMEM_STEP - 1);
+    n = MIN(n, mem->max);
+
+    err = mprotect(mem->base + mem->size, n - mem->size, prot);
+    if (err < 0)
+        return -errno;
+
+    mem->size = n;
+
+    return 0;
+}
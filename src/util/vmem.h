@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VMEM_H_
+#define VMEM_H_
+
+#include <stddef.h>
+
+/*
+ * A contiguous memory region which can grow without ever being moved.
+ * Address space for 'max' bytes is reserved up front and made accessible
+ * on demand, so pointers into the region stay valid while it grows.
+ */
+struct vmem {
+    char *base;
+    size_t size;
+    size_t max;
+};
+
+int vmem_init(struct vmem *mem, size_t max);
+
+void vmem_destroy(struct vmem *mem);
+
+int vmem_grow(struct vmem *mem, size_t size);
+
+#endif /* VMEM_H_ */
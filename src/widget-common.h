@@ -18,6 +18,7 @@
 #ifndef WIDGET_COMMON_H_
 #define WIDGET_COMMON_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct color {
@@ -55,4 +56,51 @@ static inline void color_set_u32(struct color *c, uint32_t rgba)
     color_set_alpha(c, rgba);
 }
 
+/* Bounding box of the pixels changed since the damage was last taken */
+struct damage {
+    uint32_t x1;
+    uint32_t y1;
+    uint32_t x2;
+    uint32_t y2;
+};
+
+static inline bool damage_empty(const struct damage *d)
+{
+    return d->x1 >= d->x2 || d->y1 >= d->y2;
+}
+
+static inline void damage_clear(struct damage *d)
+{
+    d->x1 = d->y1 = d->x2 = d->y2 = 0;
+}
+
+static inline void damage_add(struct damage *d,
+                              uint32_t x1,
+                              uint32_t y1,
+                              uint32_t x2,
+                              uint32_t y2)
+{
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    if (damage_empty(d)) {
+        d->x1 = x1;
+        d->y1 = y1;
+        d->x2 = x2;
+        d->y2 = y2;
+        return;
+    }
+
+    d->x1 = (x1 < d->x1) ? x1 : d->x1;
+    d->y1 = (y1 < d->y1) ? y1 : d->y1;
+    d->x2 = (x2 > d->x2) ? x2 : d->x2;
+    d->y2 = (y2 > d->y2) ? y2 : d->y2;
+}
+
+/* Range of bytes of a string, e.g. the part of a name matching a term */
+struct span {
+    int begin;
+    int end;
+};
+
 #endif /* WIDGET_COMMON_H_ */
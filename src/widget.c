@@ -15,6 +15,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <ctype.h>
 #include <stdint.h>
 #include <unistd.h>
 
@@ -63,61 +64,119 @@ static void widget_configure_list_view(struct widget *widget,
     list_view_configure(&widget->list_view, extents, x1, y1, x2, y2);
 }
 
+static void widget_update_status(struct widget *widget)
+{
+    const struct list_view *view = &widget->list_view;
+    const char *mode = "";
+
+    if (list_view_search_mode(view) == APP_LIST_SEARCH_REGEX)
+        mode = "regex ";
+    else if (list_view_search_mode(view) == APP_LIST_SEARCH_ACRONYM)
+        mode = "acronym ";
+    else if (list_view_search_mode(view) == APP_LIST_SEARCH_APPROX)
+        mode = "approx ";
+    else if (list_view_search_mode(view) == APP_LIST_SEARCH_PATH)
+        mode = "path ";
+
+    line_edit_set_status(&widget->line_edit,
+                         "%s%d/%d",
+                         mode,
+                         list_view_match_count(view),
+                         item_list_size(view->items));
+}
+
+/* Switches to 'mode' or back to substring matching if already active */
+static void widget_toggle_mode(struct widget *widget, int mode)
+{
+    TIMER_INIT_SIMPLE();
+
+    if (list_view_search_mode(&widget->list_view) == mode)
+        mode = APP_LIST_SEARCH_SUBSTRING;
+
+    list_view_set_search_mode(&widget->list_view, mode);
+
+    widget_update_status(widget);
+}
+
 static void widget_clear(struct widget *widget)
 {
     TIMER_INIT_SIMPLE();
 
-    line_edit_clear(&widget->line_edit);
     list_view_lookup_clear(&widget->list_view);
+
+    widget_update_status(widget);
+    line_edit_clear(&widget->line_edit);
 }
 
 static void widget_event_add_char(struct widget *widget, int c)
 {
     TIMER_INIT_SIMPLE();
 
-    cairo_push_group(widget->cairo);
+    list_view_lookup_push_back(&widget->list_view, c);
 
+    widget_update_status(widget);
     line_edit_push_back(&widget->line_edit, c);
-    list_view_lookup_push_back(&widget->list_view, c);
+}
 
-    cairo_pop_group_to_source(widget->cairo);
-    cairo_paint(widget->cairo);
+static void
+widget_event_add_str(struct widget *widget, const char *str, int len)
+{
+    TIMER_INIT_SIMPLE();
+
+    list_view_lookup_push_str(&widget->list_view, str, len);
+
+    widget_update_status(widget);
+    line_edit_push_str(&widget->line_edit, str, len);
 }
 
 static void widget_event_remove_char(struct widget *widget)
 {
     TIMER_INIT_SIMPLE();
 
-    cairo_push_group(widget->cairo);
-
-    line_edit_pop_back(&widget->line_edit);
     list_view_lookup_pop_back(&widget->list_view);
 
-    cairo_pop_group_to_source(widget->cairo);
-    cairo_paint(widget->cairo);
+    widget_update_status(widget);
+    line_edit_pop_back(&widget->line_edit);
 }
 
 __attribute__((noreturn)) static void widget_exec_item(struct widget *widget)
 {
-    const char *file;
+    const struct item_list *list;
+    struct history *hist;
+    const char *str;
     char *argv[2];
+    int index, len;
 
-    file = list_view_get_entry(&widget->list_view);
-    if (!file)
+    index = list_view_get_entry(&widget->list_view);
+    if (index < 0)
         exit(EXIT_SUCCESS);
 
+    list = list_view_item_list(&widget->list_view);
+    hist = list_view_history(&widget->list_view);
+
+    if (hist) {
+        history_record(hist,
+                       list_view_lookup(&widget->list_view),
+                       list_view_lookup_len(&widget->list_view),
+                       item_list_name(list, index),
+                       item_list_name_len(list, index));
+    }
+
+    str = item_list_output(list, index);
+    len = item_list_output_len(list, index);
+
     if (widget->dry_run) {
-        fprintf(stdout, "%s\n", file);
+        fprintf(stdout, "%.*s\n", len, str);
         exit(EXIT_SUCCESS);
     }
 
-    /* Values in 'argv' cannot be assigned to a 'const' pointer. */
-    argv[0] = strdupa(file);
+    /* Item names are not necessarily terminated by a null byte. */
+    argv[0] = strndupa(str, len);
     argv[1] = NULL;
 
-    execvp(file, argv);
+    execvp(argv[0], argv);
 
-    die("failed to execute \"%s\"\n", file);
+    die("failed to execute \"%s\"\n", argv[0]);
 }
 
 void widget_init(struct widget *widget)
@@ -143,11 +202,15 @@ void widget_init(struct widget *widget)
     if (unlikely(error))
         die("failed to initialize font library\n");
 
+    render_init(&widget->render);
+
     line_edit_init(&widget->line_edit);
     line_edit_set_cairo(&widget->line_edit, widget->cairo);
+    line_edit_set_render(&widget->line_edit, &widget->render);
 
     list_view_init(&widget->list_view);
     list_view_set_cairo(&widget->list_view, widget->cairo);
+    list_view_set_render(&widget->list_view, &widget->render);
 
     cairo_surface_destroy(surface);
 }
@@ -157,6 +220,7 @@ void widget_destroy(struct widget *widget)
 #ifdef MEM_NOLEAK
     list_view_destroy(&widget->list_view);
     line_edit_destroy(&widget->line_edit);
+    render_destroy(&widget->render);
 
     /* Cairo does not seem to nicely interact with valgrind. */
     cairo_destroy(widget->cairo);
@@ -187,6 +251,10 @@ void widget_set_surface(struct widget *widget, cairo_surface_t *surface)
     line_edit_set_cairo(&widget->line_edit, widget->cairo);
     list_view_set_cairo(&widget->list_view, widget->cairo);
 
+    /* The font is final once the widget is shown for the first time */
+    render_set_surface(&widget->render, surface);
+    render_set_font(&widget->render, cairo_get_scaled_font(widget->cairo));
+
     cairo_clip_extents(widget->cairo, &x1, &y1, &x2, &y2);
 
     widget->width = (uint32_t) (x2 - x1);
@@ -272,8 +340,53 @@ void widget_draw(struct widget *widget)
     cairo_stroke(widget->cairo);
 
     /* Draw individual widgets */
+    widget_update_status(widget);
     line_edit_draw(&widget->line_edit);
     list_view_draw(&widget->list_view);
+
+    damage_add(&widget->damage, 0, 0, widget->width, widget->height);
+}
+
+void widget_update(struct widget *widget)
+{
+    TIMER_INIT_SIMPLE();
+
+    if (!widget_dirty(widget))
+        return;
+
+    cairo_push_group(widget->cairo);
+
+    line_edit_update(&widget->line_edit);
+    list_view_update(&widget->list_view);
+
+    cairo_pop_group_to_source(widget->cairo);
+    cairo_paint(widget->cairo);
+}
+
+int widget_take_damage(struct widget *widget, struct damage *damage)
+{
+    const struct damage *parts[] = {
+        &widget->damage,
+        line_edit_damage(&widget->line_edit),
+        list_view_damage(&widget->list_view),
+    };
+    int n = 0;
+
+    /* The whole widget covers the damage of the sub-widgets */
+    if (!damage_empty(&widget->damage)) {
+        damage[n++] = widget->damage;
+    } else {
+        for (int i = 0; i < ARRAY_SIZE(parts); ++i) {
+            if (!damage_empty(parts[i]))
+                damage[n++] = *parts[i];
+        }
+    }
+
+    damage_clear(&widget->damage);
+    line_edit_clear_damage(&widget->line_edit);
+    list_view_clear_damage(&widget->list_view);
+
+    return n;
 }
 
 bool widget_do_key_event(struct widget *widget, struct key_event ev)
@@ -299,6 +412,18 @@ bool widget_do_key_event(struct widget *widget, struct key_event ev)
             break;
         case XKB_KEY_c:
             return false;
+        case XKB_KEY_r:
+            widget_toggle_mode(widget, APP_LIST_SEARCH_REGEX);
+            break;
+        case XKB_KEY_a:
+            widget_toggle_mode(widget, APP_LIST_SEARCH_ACRONYM);
+            break;
+        case XKB_KEY_e:
+            widget_toggle_mode(widget, APP_LIST_SEARCH_APPROX);
+            break;
+        case XKB_KEY_p:
+            widget_toggle_mode(widget, APP_LIST_SEARCH_PATH);
+            break;
         default:
             break;
         }
@@ -312,15 +437,17 @@ bool widget_do_key_event(struct widget *widget, struct key_event ev)
     case XKB_KEY_Control_L:
         break;
     case XKB_KEY_Home:
-        /* FALLTHROUGH */
-    case XKB_KEY_Page_Up:
         list_view_select_first(&widget->list_view);
         break;
+    case XKB_KEY_Page_Up:
+        list_view_page_up(&widget->list_view);
+        break;
     case XKB_KEY_End:
-        /* FALLTHROUGH */
-    case XKB_KEY_Page_Down:
         list_view_select_last(&widget->list_view);
         break;
+    case XKB_KEY_Page_Down:
+        list_view_page_down(&widget->list_view);
+        break;
     case XKB_KEY_ISO_Left_Tab:
     case XKB_KEY_Up:
         list_view_up(&widget->list_view);
@@ -346,3 +473,37 @@ bool widget_do_key_event(struct widget *widget, struct key_event ev)
 
     return true;
 }
+
+void widget_do_search_event(struct widget *widget)
+{
+    TIMER_INIT_SIMPLE();
+
+    list_view_search_update(&widget->list_view);
+
+    widget_update_status(widget);
+}
+
+void widget_do_paste_event(struct widget *widget, const char *str, size_t len)
+{
+    char buf[ARRAY_SIZE(widget->line_edit.str)];
+    int n = 0;
+
+    /* Only the printable characters of the first line are of interest */
+    for (size_t i = 0; i < len && str[i] != '\n' && n < ARRAY_SIZE(buf); ++i) {
+        if (isascii(str[i]) && isprint(str[i]))
+            buf[n++] = str[i];
+    }
+
+    if (n)
+        widget_event_add_str(widget, buf, n);
+}
+
+void widget_do_input_event(struct widget *widget)
+{
+    TIMER_INIT_SIMPLE();
+
+    list_view_stream_read(&widget->list_view);
+
+    /* New items change the number of matches */
+    widget_update_status(widget);
+}
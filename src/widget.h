@@ -31,6 +31,7 @@
 #include "item-list.h"
 #include "line-edit.h"
 #include "list-view.h"
+#include "render.h"
 #include "widget-common.h"
 
 struct key_event {
@@ -41,15 +42,44 @@ struct key_event {
     uint8_t mod1 : 1;
 };
 
+/* The frame, the line edit and the list view are damaged separately */
+#define WIDGET_DAMAGE_MAX 3
+
+#define WIDGET_PASTE_NONE 0
+#define WIDGET_PASTE_CLIPBOARD 1
+#define WIDGET_PASTE_PRIMARY 2
+
+/*
+ * Returns the selection to paste for a key event. The window has to
+ * fetch the selection's content, which is passed back to the widget
+ * with widget_do_paste_event().
+ */
+static inline int widget_paste_source(struct key_event ev)
+{
+    if (ev.ctrl && (ev.symbol == XKB_KEY_v || ev.symbol == XKB_KEY_V))
+        return WIDGET_PASTE_CLIPBOARD;
+
+    if (ev.shift && ev.symbol == XKB_KEY_Insert)
+        return WIDGET_PASTE_PRIMARY;
+
+    return WIDGET_PASTE_NONE;
+}
+
 struct widget {
     FT_Library freetype;
     FT_Face face;
 
     cairo_t *cairo;
 
+    /* Draws text from a glyph atlas if enabled and possible */
+    struct render render;
+
     uint32_t width;
     uint32_t height;
 
+    /* Set if the whole widget including its frame was drawn */
+    struct damage damage;
+
     bool dry_run;
 
     struct color frame;
@@ -86,6 +116,11 @@ static inline void widget_set_font_size(struct widget *widget, uint32_t size)
     cairo_set_font_size(widget->cairo, (double) size);
 }
 
+static inline void widget_set_atlas(struct widget *widget, bool enabled)
+{
+    render_set_enabled(&widget->render, enabled);
+}
+
 static inline void widget_set_frame_color(struct widget *widget, uint32_t value)
 {
     color_set_u32(&widget->frame, value);
@@ -110,12 +145,58 @@ static inline void widget_set_item_list(struct widget *widget,
                                         struct item_list *list)
 {
     list_view_set_item_list(&widget->list_view, list);
+
+    /* The list may come with an initial lookup string */
+    line_edit_set_text(&widget->line_edit,
+                       item_list_lookup(list),
+                       item_list_lookup_len(list));
+}
+
+static inline void widget_set_history(struct widget *widget,
+                                      struct history *hist)
+{
+    list_view_set_history(&widget->list_view, hist);
+}
+
+static inline int widget_input_fd(const struct widget *widget)
+{
+    return list_view_input_fd(&widget->list_view);
+}
+
+static inline int widget_search_fd(const struct widget *widget)
+{
+    return list_view_search_fd(&widget->list_view);
 }
 
 void widget_set_size(struct widget *widget, uint32_t width, uint32_t height);
 
 void widget_draw(struct widget *widget);
 
+/*
+ * Events only change the state of the widget. Returns true if it has to
+ * be drawn again with widget_update() to show the changes.
+ */
+static inline bool widget_dirty(const struct widget *widget)
+{
+    return line_edit_dirty(&widget->line_edit)
+           || list_view_dirty(&widget->list_view);
+}
+
+/* Draws only the parts of the widget which changed since they were drawn */
+void widget_update(struct widget *widget);
+
+/*
+ * Stores the areas drawn since the last call in 'damage' and returns
+ * their number, which is at most WIDGET_DAMAGE_MAX.
+ */
+int widget_take_damage(struct widget *widget, struct damage *damage);
+
 bool widget_do_key_event(struct widget *widget, struct key_event ev);
 
+void widget_do_search_event(struct widget *widget);
+
+void widget_do_paste_event(struct widget *widget, const char *str, size_t len);
+
+void widget_do_input_event(struct widget *widget);
+
 #endif /* WIDGET_H_ */
@@ -22,6 +22,7 @@
 
 #ifdef CONFIG_USE_X11
 
+#include <xcb/shm.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_keysyms.h>
 
@@ -40,13 +41,36 @@ struct window {
     xcb_intern_atom_cookie_t net_wm_window_type_cookie;
     xcb_intern_atom_cookie_t net_wm_window_type_utility_cookie;
     xcb_intern_atom_cookie_t motif_wm_hints_cookie;
+    xcb_intern_atom_cookie_t clipboard_cookie;
+    xcb_intern_atom_cookie_t utf8_string_cookie;
+    xcb_intern_atom_cookie_t selection_cookie;
     xcb_grab_keyboard_cookie_t grab_keyboard_cookie;
 
     xcb_intern_atom_reply_t *net_wm_window_type;
     xcb_intern_atom_reply_t *net_wm_window_type_utility;
     xcb_intern_atom_reply_t *motif_wm_hints;
+    xcb_intern_atom_reply_t *clipboard;
+    xcb_intern_atom_reply_t *utf8_string;
+    xcb_intern_atom_reply_t *selection;
     xcb_grab_keyboard_reply_t *grab_keyboard;
 
+    /*
+     * If the visual allows it, the widget is drawn into the canvas on
+     * the client side and only its damage is sent to the server, from a
+     * shared memory segment if possible.
+     */
+    uint8_t *canvas;
+    uint32_t stride;
+    struct damage damage[WIDGET_DAMAGE_MAX];
+    int n_damage;
+    xcb_gcontext_t gc;
+
+    /* The segment is not written while the server may still read it */
+    uint8_t *shm;
+    xcb_shm_seg_t shm_seg;
+    uint8_t shm_event;
+    int shm_pending;
+
     uint32_t width;
     uint32_t height;
 };
@@ -58,6 +82,20 @@ struct window {
 #include "widget.h"
 #include "xkb.h"
 
+/* Number of buffers the compositor may hold on to at the same time */
+#define WINDOW_BUFFERS 3
+
+struct window_buffer {
+    struct wl_buffer *buffer;
+    uint8_t *data;
+
+    /* Area in which the buffer differs from the canvas */
+    struct damage stale;
+
+    /* Set while the compositor may still read from the buffer */
+    bool busy;
+};
+
 struct window {
     struct widget widget;
     struct xkb xkb;
@@ -67,21 +105,50 @@ struct window {
     struct wl_compositor *compositor;
     struct wl_shell *shell;
     struct wl_shm *shm;
-    struct wl_buffer *buffer;
     struct wl_seat *seat;
     struct wl_output *output;
     struct wl_keyboard *keyboard;
     struct xdg_wm_base *xdg_wm;
 
+    /* The newest data offer and the clipboard's current one */
+    struct wl_data_device_manager *data_device_manager;
+    struct wl_data_device *data_device;
+    struct wl_data_offer *offer;
+    const char *offer_mime;
+    struct wl_data_offer *selection;
+    const char *selection_mime;
+
     struct wl_surface *wl_surface;
     struct xdg_surface *xdg_surface;
     struct xdg_toplevel *xdg_toplevel;
 
+    /*
+     * The widget is drawn into the canvas. Its damage is copied into
+     * whichever buffer is free once it is committed.
+     */
+    uint8_t *canvas;
+    struct window_buffer buffers[WINDOW_BUFFERS];
+    struct damage damage[WIDGET_DAMAGE_MAX];
+    int n_damage;
+
+    /*
+     * Pending until the compositor is ready for the next frame. The
+     * widget is not drawn until then, events only change its state.
+     */
+    struct wl_callback *frame;
+
+    /* Memory of all buffers, they share a single pool */
     void *mem;
     size_t size;
+    uint32_t stride;
 
     int epoll_fd;
     int timer_fd;
+    int input_fd;
+    int paste_fd;
+
+    char paste[64];
+    size_t paste_len;
 
     uint32_t width;
     uint32_t height;
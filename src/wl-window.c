@@ -16,6 +16,7 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
@@ -33,11 +34,16 @@
 #include "util/io-util.h"
 #include "util/macro.h"
 #include "util/string-util.h"
+#include "util/xalloc.h"
 
 #ifdef CONFIG_USE_WAYLAND
 
 #define WL_WINDOW_BYTES_PER_PIXEL 4
 
+struct window_event {
+    void (*dispatch)(struct window *);
+};
+
 static void window_xdg_toplevel_surface_configure(void *data,
                                                   struct xdg_toplevel *toplevel,
                                                   int32_t width,
@@ -215,6 +221,159 @@ static void window_bind_shm(struct window *win, uint32_t name, uint32_t version)
         die("failed to create binding\n");
 }
 
+static void
+window_bind_data_device_manager(struct window *win,
+                                uint32_t name,
+                                uint32_t version)
+{
+    if (win->data_device_manager)
+        return;
+
+    win->data_device_manager =
+        wl_registry_bind(win->registry,
+                         name,
+                         &wl_data_device_manager_interface,
+                         MIN(version, 3));
+
+    if (!win->data_device_manager)
+        die("failed to create binding\n");
+}
+
+static void window_data_offer_offer(void *data,
+                                    struct wl_data_offer *offer,
+                                    const char *mime_type)
+{
+    static const char *mime_types[] = {
+        "text/plain;charset=utf-8",
+        "text/plain",
+        "UTF8_STRING",
+        "STRING",
+    };
+    struct window *win = data;
+
+    if (offer != win->offer)
+        return;
+
+    /* Use the first supported type, whichever order they come in */
+    for (int i = 0; i < ARRAY_SIZE(mime_types); ++i) {
+        if (win->offer_mime == mime_types[i])
+            return;
+
+        if (streq(mime_types[i], mime_type)) {
+            win->offer_mime = mime_types[i];
+            return;
+        }
+    }
+}
+
+static void window_data_offer_source_actions(void *data,
+                                             struct wl_data_offer *offer,
+                                             uint32_t actions)
+{
+    (void) data;
+    (void) offer;
+    (void) actions;
+}
+
+static void window_data_offer_action(void *data,
+                                     struct wl_data_offer *offer,
+                                     uint32_t action)
+{
+    (void) data;
+    (void) offer;
+    (void) action;
+}
+
+static const struct wl_data_offer_listener window_data_offer_callbacks = {
+    .offer = &window_data_offer_offer,
+    .source_actions = &window_data_offer_source_actions,
+    .action = &window_data_offer_action,
+};
+
+static void window_data_device_data_offer(void *data,
+                                          struct wl_data_device *device,
+                                          struct wl_data_offer *offer)
+{
+    struct window *win = data;
+
+    (void) device;
+
+    /* The offered mime types are announced right after the offer */
+    win->offer = offer;
+    win->offer_mime = NULL;
+
+    wl_data_offer_add_listener(offer, &window_data_offer_callbacks, win);
+}
+
+static void window_data_device_enter(void *data,
+                                     struct wl_data_device *device,
+                                     uint32_t serial,
+                                     struct wl_surface *surface,
+                                     int32_t x,
+                                     int32_t y,
+                                     struct wl_data_offer *offer)
+{
+    (void) data;
+    (void) device;
+    (void) serial;
+    (void) surface;
+    (void) x;
+    (void) y;
+
+    /* Drag and drop is not supported */
+    if (offer)
+        wl_data_offer_destroy(offer);
+}
+
+static void window_data_device_leave(void *data, struct wl_data_device *device)
+{
+    (void) data;
+    (void) device;
+}
+
+static void window_data_device_motion(void *data,
+                                      struct wl_data_device *device,
+                                      uint32_t time,
+                                      int32_t x,
+                                      int32_t y)
+{
+    (void) data;
+    (void) device;
+    (void) time;
+    (void) x;
+    (void) y;
+}
+
+static void window_data_device_drop(void *data, struct wl_data_device *device)
+{
+    (void) data;
+    (void) device;
+}
+
+static void window_data_device_selection(void *data,
+                                         struct wl_data_device *device,
+                                         struct wl_data_offer *offer)
+{
+    struct window *win = data;
+
+    (void) device;
+
+    if (win->selection)
+        wl_data_offer_destroy(win->selection);
+
+    win->selection = offer;
+    win->selection_mime = (offer == win->offer) ? win->offer_mime : NULL;
+}
+
+static const struct wl_data_device_listener window_data_device_callbacks = {
+    .data_offer = &window_data_device_data_offer,
+    .enter = &window_data_device_enter,
+    .leave = &window_data_device_leave,
+    .motion = &window_data_device_motion,
+    .drop = &window_data_device_drop,
+    .selection = &window_data_device_selection,
+};
+
 static void window_keyboard_keymap(void *data,
                                    struct wl_keyboard *keyboard,
                                    uint32_t format,
@@ -272,6 +431,253 @@ static void window_keyboard_leave(void *data,
     (void) surface;
 }
 
+/* Damage of the canvas is pending until it is committed */
+static void window_add_damage(struct window *win, const struct damage *damage)
+{
+    int n = win->n_damage;
+
+    for (int i = 0; i < ARRAY_SIZE(win->buffers); ++i) {
+        damage_add(&win->buffers[i].stale,
+                   damage->x1,
+                   damage->y1,
+                   damage->x2,
+                   damage->y2);
+    }
+
+    /* Damage which does not fit anymore is merged into the last box */
+    if (n < ARRAY_SIZE(win->damage))
+        win->damage[win->n_damage++] = *damage;
+    else
+        damage_add(&win->damage[n - 1],
+                   damage->x1,
+                   damage->y1,
+                   damage->x2,
+                   damage->y2);
+}
+
+/* Returns the free buffer which is the least out of date or NULL */
+static struct window_buffer *window_next_buffer(struct window *win)
+{
+    struct window_buffer *next = NULL;
+    uint64_t min = UINT64_MAX;
+
+    for (int i = 0; i < ARRAY_SIZE(win->buffers); ++i) {
+        struct window_buffer *buf = &win->buffers[i];
+        uint64_t area;
+
+        if (buf->busy)
+            continue;
+
+        area = (uint64_t) (buf->stale.x2 - buf->stale.x1)
+               * (buf->stale.y2 - buf->stale.y1);
+
+        if (area < min) {
+            next = buf;
+            min = area;
+        }
+    }
+
+    return next;
+}
+
+/* Brings the buffer up to date by copying the stale area of the canvas */
+static void window_refresh_buffer(struct window *win, struct window_buffer *buf)
+{
+    const struct damage *stale = &buf->stale;
+    size_t offset, len;
+
+    if (damage_empty(stale))
+        return;
+
+    offset = stale->y1 * win->stride + stale->x1 * WL_WINDOW_BYTES_PER_PIXEL;
+    len = (stale->x2 - stale->x1) * WL_WINDOW_BYTES_PER_PIXEL;
+
+    for (uint32_t y = stale->y1; y < stale->y2; ++y) {
+        memcpy(buf->data + offset, win->canvas + offset, len);
+        offset += win->stride;
+    }
+
+    damage_clear(&buf->stale);
+}
+
+static const struct wl_callback_listener window_frame_callbacks;
+
+/*
+ * Commits the areas the widget has drawn to. At most one commit is made
+ * per frame and if the compositor still holds all buffers, the damage is
+ * committed once one is released.
+ */
+static void window_commit_surface(struct window *win)
+{
+    struct damage damage[WIDGET_DAMAGE_MAX];
+    struct window_buffer *buf;
+    int n;
+
+    TIMER_INIT_SIMPLE();
+
+    n = widget_take_damage(&win->widget, damage);
+
+    for (int i = 0; i < n; ++i)
+        window_add_damage(win, &damage[i]);
+
+    if (!win->n_damage || win->frame)
+        return;
+
+    buf = window_next_buffer(win);
+    if (!buf)
+        return;
+
+    window_refresh_buffer(win, buf);
+
+    wl_surface_attach(win->wl_surface, buf->buffer, 0, 0);
+
+    for (int i = 0; i < win->n_damage; ++i) {
+        const struct damage *d = &win->damage[i];
+
+        wl_surface_damage_buffer(win->wl_surface,
+                                 (int32_t) d->x1,
+                                 (int32_t) d->y1,
+                                 (int32_t) (d->x2 - d->x1),
+                                 (int32_t) (d->y2 - d->y1));
+    }
+
+    win->frame = wl_surface_frame(win->wl_surface);
+    if (!win->frame)
+        die("failed to request frame callback\n");
+
+    wl_callback_add_listener(win->frame, &window_frame_callbacks, win);
+
+    wl_surface_commit(win->wl_surface);
+
+    buf->busy = true;
+    win->n_damage = 0;
+}
+
+/*
+ * Draws the changes of the widget and commits them. Events arriving while
+ * a frame is pending or while all buffers are held by the compositor only
+ * change the widget's state, which is drawn once the next frame is due.
+ */
+static void window_update(struct window *win)
+{
+    if (win->frame || !window_next_buffer(win))
+        return;
+
+    widget_update(&win->widget);
+    window_commit_surface(win);
+}
+
+static void window_buffer_release(void *data, struct wl_buffer *buffer)
+{
+    struct window *win = data;
+
+    for (int i = 0; i < ARRAY_SIZE(win->buffers); ++i) {
+        if (win->buffers[i].buffer == buffer)
+            win->buffers[i].busy = false;
+    }
+
+    /* Changes may have been waiting for a free buffer */
+    window_update(win);
+}
+
+static const struct wl_buffer_listener window_buffer_callbacks = {
+    .release = &window_buffer_release,
+};
+
+static void
+window_frame_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+    struct window *win = data;
+
+    (void) time;
+
+    wl_callback_destroy(callback);
+    win->frame = NULL;
+
+    /* Everything changed since the last frame is drawn at once */
+    window_update(win);
+}
+
+static const struct wl_callback_listener window_frame_callbacks = {
+    .done = &window_frame_done,
+};
+
+static void window_finish_paste(struct window *win)
+{
+    int err;
+
+    err = epoll_ctl(win->epoll_fd, EPOLL_CTL_DEL, win->paste_fd, NULL);
+    if (err < 0)
+        die("epoll_ctl: failed to remove paste events: %s\n", errstr(errno));
+
+    close(win->paste_fd);
+    win->paste_fd = -1;
+
+    widget_do_paste_event(&win->widget, win->paste, win->paste_len);
+    window_update(win);
+}
+
+static void window_dispatch_paste_event(struct window *win)
+{
+    while (win->paste_len < ARRAY_SIZE(win->paste)) {
+        char *buf = win->paste + win->paste_len;
+        size_t size = ARRAY_SIZE(win->paste) - win->paste_len;
+        ssize_t n;
+
+        n = read(win->paste_fd, buf, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            die("failed to read pasted data: %s\n", errstr(errno));
+        }
+
+        if (!n)
+            break;
+
+        win->paste_len += n;
+    }
+
+    /* Anything beyond the first bytes would not fit into the line edit */
+    window_finish_paste(win);
+}
+
+static struct window_event window_paste_event = {
+    .dispatch = &window_dispatch_paste_event};
+
+/*
+ * Asks the owner of the clipboard to write its content into a pipe which
+ * is read as soon as data is available.
+ */
+static void window_request_paste(struct window *win)
+{
+    struct epoll_event ev;
+    int fds[2], err;
+
+    if (!win->selection || !win->selection_mime || win->paste_fd >= 0)
+        return;
+
+    err = pipe2(fds, O_CLOEXEC | O_NONBLOCK);
+    if (err < 0)
+        die("failed to create pipe for pasting: %s\n", errstr(errno));
+
+    wl_data_offer_receive(win->selection, win->selection_mime, fds[1]);
+    close(fds[1]);
+
+    win->paste_fd = fds[0];
+    win->paste_len = 0;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &window_paste_event;
+
+    err = epoll_ctl(win->epoll_fd, EPOLL_CTL_ADD, win->paste_fd, &ev);
+    if (err < 0)
+        die("epoll_ctl: failed to add paste events: %s\n", errstr(errno));
+}
+
 static void window_keyboard_key(void *data,
                                 struct wl_keyboard *keyboard,
                                 uint32_t serial,
@@ -291,7 +697,7 @@ static void window_keyboard_key(void *data,
     if (!xkb_ready(&win->xkb))
         return;
 
-    if (!win->buffer)
+    if (!win->canvas)
         return;
 
     symbol = xkb_get_sym(&win->xkb, key);
@@ -312,7 +718,11 @@ static void window_keyboard_key(void *data,
         ev.shift = xkb_mod_active(&win->xkb, XKB_MOD_NAME_SHIFT);
         ev.mod1 = xkb_mod_active(&win->xkb, XKB_MOD_NAME_ALT);
 
-        win->active = widget_do_key_event(&win->widget, ev);
+        /* There is only a clipboard, but no primary selection */
+        if (widget_paste_source(ev) != WIDGET_PASTE_NONE)
+            window_request_paste(win);
+        else
+            win->active = widget_do_key_event(&win->widget, ev);
 
         win->symbol = symbol;
         break;
@@ -330,10 +740,7 @@ static void window_keyboard_key(void *data,
         break;
     }
 
-    widget_draw(&win->widget);
-    wl_surface_attach(win->wl_surface, win->buffer, 0, 0);
-    wl_surface_damage_buffer(win->wl_surface, 0, 0, win->width, win->height);
-    wl_surface_commit(win->wl_surface);
+    window_update(win);
 }
 
 static void window_keyboard_modifiers(void *data,
@@ -428,6 +835,7 @@ window_bind_xdg_wm(struct window *win, uint32_t name, uint32_t version)
 
 static const struct window_bind_callback window_bind_callbacks[] = {
     {"wl_compositor", &window_bind_compositor},
+    {"wl_data_device_manager", &window_bind_data_device_manager},
     {"wl_output", &window_bind_output},
     {"wl_seat", &window_bind_seat},
     {"wl_shell", &window_bind_shell},
@@ -503,6 +911,19 @@ static void window_init_wayland(struct window *win, const char *display_name)
 
     xdg_wm_base_add_listener(win->xdg_wm, &xdg_wm_callbacks, win);
 
+    /* Pasting is not possible without a data device */
+    if (win->data_device_manager && win->seat) {
+        win->data_device =
+            wl_data_device_manager_get_data_device(win->data_device_manager,
+                                                   win->seat);
+        if (!win->data_device)
+            die("failed to create data device\n");
+
+        wl_data_device_add_listener(win->data_device,
+                                    &window_data_device_callbacks,
+                                    win);
+    }
+
     win->wl_surface = wl_compositor_create_surface(win->compositor);
 
     win->xdg_surface =
@@ -521,10 +942,6 @@ static void window_init_wayland(struct window *win, const char *display_name)
     wl_display_roundtrip(win->display);
 }
 
-struct window_event {
-    void (*dispatch)(struct window *);
-};
-
 static void window_dispatch_wayland_event(struct window *win)
 {
     int err;
@@ -559,6 +976,24 @@ static void window_dispatch_timer_event(struct window *win)
     ev.mod1 = xkb_mod_active(&win->xkb, XKB_MOD_NAME_ALT);
 
     (void) widget_do_key_event(&win->widget, ev);
+
+    window_update(win);
+}
+
+static void window_dispatch_input_event(struct window *win)
+{
+    widget_do_input_event(&win->widget);
+    window_update(win);
+}
+
+/*
+ * Search results arriving faster than frames are shown only replace the
+ * one to be drawn next.
+ */
+static void window_dispatch_search_event(struct window *win)
+{
+    widget_do_search_event(&win->widget);
+    window_update(win);
 }
 
 static struct window_event window_wayland_event = {
@@ -567,6 +1002,12 @@ static struct window_event window_wayland_event = {
 static struct window_event window_timer_event = {
     .dispatch = &window_dispatch_timer_event};
 
+static struct window_event window_input_event = {
+    .dispatch = &window_dispatch_input_event};
+
+static struct window_event window_search_event = {
+    .dispatch = &window_dispatch_search_event};
+
 static void window_init_events(struct window *win)
 {
     TIMER_INIT_SIMPLE();
@@ -598,6 +1039,55 @@ static void window_init_events(struct window *win)
     if (err < 0)
         die("epoll_ctl: failed to add timer events: %s\n", errstr(errno));
 }
+
+static void window_init_search_events(struct window *win)
+{
+    struct epoll_event ev;
+    int err;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &window_search_event;
+
+    err = epoll_ctl(win->epoll_fd,
+                    EPOLL_CTL_ADD,
+                    widget_search_fd(&win->widget),
+                    &ev);
+    if (err < 0)
+        die("epoll_ctl: failed to add search events: %s\n", errstr(errno));
+}
+
+/*
+ * The input is only watched while new items can be added, i.e. until all
+ * of its data has been read and not while a lookup is running.
+ */
+static void window_update_input_events(struct window *win)
+{
+    struct epoll_event ev;
+    int fd, err;
+
+    fd = widget_input_fd(&win->widget);
+    if (fd == win->input_fd)
+        return;
+
+    if (win->input_fd >= 0) {
+        err = epoll_ctl(win->epoll_fd, EPOLL_CTL_DEL, win->input_fd, NULL);
+        if (err < 0)
+            die("epoll_ctl: failed to remove input events: %s\n",
+                errstr(errno));
+    }
+
+    win->input_fd = fd;
+    if (fd < 0)
+        return;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &window_input_event;
+
+    err = epoll_ctl(win->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    if (err < 0)
+        die("epoll_ctl: failed to add input events: %s\n", errstr(errno));
+}
+
 static bool window_widget_surface_initialized(const struct window *win)
 {
     return win->mem != NULL;
@@ -606,7 +1096,9 @@ static bool window_widget_surface_initialized(const struct window *win)
 static void window_set_widget_surface(struct window *win)
 {
     struct wl_shm_pool *pool;
+    struct wl_region *region;
     cairo_surface_t *surface;
+    size_t buffer_size;
     int fd, err;
     int32_t stride;
 
@@ -615,7 +1107,10 @@ static void window_set_widget_surface(struct window *win)
     widget_get_size_hint(&win->widget, &win->width, &win->height);
 
     stride = win->width * WL_WINDOW_BYTES_PER_PIXEL;
-    win->size = stride * win->height;
+    buffer_size = (size_t) stride * win->height;
+
+    win->stride = (uint32_t) stride;
+    win->size = ARRAY_SIZE(win->buffers) * buffer_size;
 
     /* Create sharable memory for drawing */
     fd = memfd_create("crudebox", MFD_CLOEXEC);
@@ -634,21 +1129,45 @@ static void window_set_widget_surface(struct window *win)
     if (!pool)
         die("failed to create shared memory pool\n");
 
-    win->buffer = wl_shm_pool_create_buffer(pool,
-                                            0,
-                                            win->width,
-                                            win->height,
-                                            stride,
-                                            WL_SHM_FORMAT_XRGB8888);
-    if (!win->buffer)
-        die("failed to create wayland buffer\n");
+    for (int i = 0; i < ARRAY_SIZE(win->buffers); ++i) {
+        struct window_buffer *buf = &win->buffers[i];
+        size_t offset = i * buffer_size;
+
+        buf->buffer = wl_shm_pool_create_buffer(pool,
+                                                (int32_t) offset,
+                                                win->width,
+                                                win->height,
+                                                stride,
+                                                WL_SHM_FORMAT_XRGB8888);
+        if (!buf->buffer)
+            die("failed to create wayland buffer\n");
+
+        wl_buffer_add_listener(buf->buffer, &window_buffer_callbacks, win);
+
+        buf->data = (uint8_t *) win->mem + offset;
+        buf->busy = false;
+
+        /* Nothing has been copied into the buffer yet */
+        damage_add(&buf->stale, 0, 0, win->width, win->height);
+    }
 
     /* Release temporary allocated ressources */
     wl_shm_pool_destroy(pool);
     close(fd);
 
+    /* The buffer has no alpha channel, so nothing behind it shows */
+    region = wl_compositor_create_region(win->compositor);
+    if (!region)
+        die("failed to create opaque region\n");
+
+    wl_region_add(region, 0, 0, (int32_t) win->width, (int32_t) win->height);
+    wl_surface_set_opaque_region(win->wl_surface, region);
+    wl_region_destroy(region);
+
     /* Create cairo surface for rendering the widget */
-    surface = cairo_image_surface_create_for_data(win->mem,
+    win->canvas = xmalloc(buffer_size);
+
+    surface = cairo_image_surface_create_for_data(win->canvas,
                                                   CAIRO_FORMAT_ARGB32,
                                                   win->width,
                                                   win->height,
@@ -667,6 +1186,8 @@ void window_init(struct window *win, const char *display_name)
     TIMER_INIT_SIMPLE();
 
     memset(win, 0, sizeof(*win));
+    win->input_fd = -1;
+    win->paste_fd = -1;
 
     xkb_init(&win->xkb);
     window_init_wayland(win, display_name);
@@ -677,12 +1198,28 @@ void window_init(struct window *win, const char *display_name)
 void window_destroy(struct window *win)
 {
 #ifdef MEM_NOLEAK
-    if (win->buffer)
-        wl_buffer_destroy(win->buffer);
+    if (win->paste_fd >= 0)
+        close(win->paste_fd);
+
+    if (win->selection)
+        wl_data_offer_destroy(win->selection);
+
+    if (win->data_device)
+        wl_data_device_destroy(win->data_device);
+
+    if (win->frame)
+        wl_callback_destroy(win->frame);
+
+    for (int i = 0; i < ARRAY_SIZE(win->buffers); ++i) {
+        if (win->buffers[i].buffer)
+            wl_buffer_destroy(win->buffers[i].buffer);
+    }
 
     if (win->mem)
         munmap(win->mem, win->size);
 
+    free(win->canvas);
+
     close(win->timer_fd);
     close(win->epoll_fd);
 
@@ -702,8 +1239,9 @@ void window_show(struct window *win)
         window_set_widget_surface(win);
 
     widget_draw(&win->widget);
-    wl_surface_attach(win->wl_surface, win->buffer, 0, 0);
-    wl_surface_commit(win->wl_surface);
+    window_commit_surface(win);
+
+    window_init_search_events(win);
 }
 
 void window_dispatch_events(struct window *win)
@@ -711,9 +1249,10 @@ void window_dispatch_events(struct window *win)
     win->active = true;
 
     while (win->active) {
-        struct epoll_event events[2];
+        struct epoll_event events[5];
         int n;
 
+        window_update_input_events(win);
         wl_display_flush(win->display);
 
         n = epoll_wait(win->epoll_fd, events, ARRAY_SIZE(events), -1);
@@ -16,9 +16,11 @@
  */
 
 #include <errno.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/shm.h>
 
 #include <cairo-xcb.h>
 #include <xkbcommon/xkbcommon.h>
@@ -27,10 +29,21 @@
 #include "window.h"
 
 #include "util/die.h"
+#include "util/errstr.h"
 #include "util/macro.h"
+#include "util/xalloc.h"
 
 #ifdef CONFIG_USE_X11
 
+#define X11_WINDOW_BYTES_PER_PIXEL 4
+
+/* Byte order of the pixels cairo draws into image surfaces */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define X11_WINDOW_IMAGE_ORDER XCB_IMAGE_ORDER_LSB_FIRST
+#else
+#define X11_WINDOW_IMAGE_ORDER XCB_IMAGE_ORDER_MSB_FIRST
+#endif
+
 static void window_set_root_visual(struct window *win)
 {
     xcb_depth_iterator_t depth_iter;
@@ -86,6 +99,9 @@ static void window_init_cookies(struct window *win)
         "_NET_WM_WINDOW_TYPE",
         "_NET_WM_WINDOW_TYPE_UTILITY",
         "_MOTIF_WM_HINTS",
+        "CLIPBOARD",
+        "UTF8_STRING",
+        "CRUDEBOX_SELECTION",
     };
 
     TIMER_INIT_SIMPLE();
@@ -99,6 +115,15 @@ static void window_init_cookies(struct window *win)
     win->motif_wm_hints_cookie =
         xcb_intern_atom(win->conn, false, strlen(names[2]), names[2]);
 
+    win->clipboard_cookie =
+        xcb_intern_atom(win->conn, false, strlen(names[3]), names[3]);
+
+    win->utf8_string_cookie =
+        xcb_intern_atom(win->conn, false, strlen(names[4]), names[4]);
+
+    win->selection_cookie =
+        xcb_intern_atom(win->conn, false, strlen(names[5]), names[5]);
+
     win->grab_keyboard_cookie = xcb_grab_keyboard(win->conn,
                                                   true,
                                                   win->screen->root,
@@ -154,21 +179,112 @@ static void window_init_frame(struct window *win)
                                &win->screen->root);
 }
 
+/* Checks if the server takes the pixels of cairo's image surfaces as is */
+static bool window_client_side_supported(const struct window *win)
+{
+    xcb_format_iterator_t iter;
+
+    if (win->setup->image_byte_order != X11_WINDOW_IMAGE_ORDER)
+        return false;
+
+    if (win->visual->_class != XCB_VISUAL_CLASS_TRUE_COLOR
+        || win->visual->red_mask != 0xff0000
+        || win->visual->green_mask != 0x00ff00
+        || win->visual->blue_mask != 0x0000ff)
+        return false;
+
+    iter = xcb_setup_pixmap_formats_iterator(win->setup);
+
+    while (iter.rem) {
+        if (iter.data->depth == win->screen->root_depth)
+            return iter.data->bits_per_pixel == 8 * X11_WINDOW_BYTES_PER_PIXEL;
+
+        xcb_format_next(&iter);
+    }
+
+    return false;
+}
+
+/*
+ * Shares memory with the server to present images from. This fails for
+ * remote servers, which are sent the images with the requests instead.
+ */
+static void window_init_shm(struct window *win, size_t size)
+{
+    const xcb_query_extension_reply_t *ext;
+    xcb_generic_error_t *error;
+    xcb_void_cookie_t cookie;
+    void *mem;
+    int id;
+
+    ext = xcb_get_extension_data(win->conn, &xcb_shm_id);
+    if (!ext || !ext->present)
+        return;
+
+    id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (id < 0)
+        return;
+
+    mem = shmat(id, NULL, 0);
+    if (mem == (void *) -1) {
+        (void) shmctl(id, IPC_RMID, NULL);
+        return;
+    }
+
+    win->shm_seg = xcb_generate_id(win->conn);
+
+    cookie = xcb_shm_attach_checked(win->conn, win->shm_seg, id, false);
+    error = xcb_request_check(win->conn, cookie);
+
+    /* The segment goes away as soon as both sides have detached */
+    (void) shmctl(id, IPC_RMID, NULL);
+
+    if (error) {
+#ifdef MEM_NOLEAK
+        free(error);
+#endif
+        (void) shmdt(mem);
+        return;
+    }
+
+    win->shm = mem;
+    win->shm_event = ext->first_event + XCB_SHM_COMPLETION;
+}
+
 static void window_init_widget(struct window *win)
 {
     cairo_surface_t *surface;
+    size_t size;
 
     TIMER_INIT_SIMPLE();
 
     /* Initialize the cairo surface to be used by the widget */
-    surface = cairo_xcb_surface_create(win->conn,
-                                       win->xid,
-                                       win->visual,
-                                       win->width,
-                                       win->height);
+    if (window_client_side_supported(win)) {
+        win->stride = win->width * X11_WINDOW_BYTES_PER_PIXEL;
+        size = (size_t) win->stride * win->height;
+
+        win->canvas = xmalloc(size);
+
+        win->gc = xcb_generate_id(win->conn);
+        (void) xcb_create_gc(win->conn, win->gc, win->xid, 0, NULL);
+
+        window_init_shm(win, size);
+
+        surface = cairo_image_surface_create_for_data(win->canvas,
+                                                      CAIRO_FORMAT_ARGB32,
+                                                      win->width,
+                                                      win->height,
+                                                      win->stride);
+    } else {
+        surface = cairo_xcb_surface_create(win->conn,
+                                           win->xid,
+                                           win->visual,
+                                           win->width,
+                                           win->height);
+    }
 
     if (unlikely(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS))
-        die("failed to create cairo xcb surface\n");
+        die("failed to create cairo surface for rendering\n");
 
     widget_set_surface(&win->widget, surface);
 
@@ -260,6 +376,24 @@ static void window_init_attributes(struct window *win)
     if (unlikely(error))
         die("failed to retrieve intern atom \"_MOTIF_WM_HINTS\"\n");
 
+    win->clipboard =
+        xcb_intern_atom_reply(win->conn, win->clipboard_cookie, &error);
+
+    if (unlikely(error))
+        die("failed to retrieve intern atom \"CLIPBOARD\"\n");
+
+    win->utf8_string =
+        xcb_intern_atom_reply(win->conn, win->utf8_string_cookie, &error);
+
+    if (unlikely(error))
+        die("failed to retrieve intern atom \"UTF8_STRING\"\n");
+
+    win->selection =
+        xcb_intern_atom_reply(win->conn, win->selection_cookie, &error);
+
+    if (unlikely(error))
+        die("failed to retrieve intern atom \"CRUDEBOX_SELECTION\"\n");
+
     /* Set window type to 'utility' */
     (void) xcb_change_property(win->conn,
                                XCB_PROP_MODE_REPLACE,
@@ -326,7 +460,19 @@ void window_destroy(struct window *win)
     (void) xcb_ungrab_keyboard(win->conn, XCB_TIME_CURRENT_TIME);
 
 #ifdef MEM_NOLEAK
+    if (win->shm) {
+        (void) xcb_shm_detach(win->conn, win->shm_seg);
+        (void) shmdt(win->shm);
+    }
+
+    if (win->canvas)
+        (void) xcb_free_gc(win->conn, win->gc);
+
+    free(win->canvas);
     free(win->grab_keyboard);
+    free(win->selection);
+    free(win->utf8_string);
+    free(win->clipboard);
     free(win->motif_wm_hints);
     free(win->net_wm_window_type_utility);
     free(win->net_wm_window_type);
@@ -360,7 +506,163 @@ void window_show(struct window *win)
     (void) xcb_map_window(win->conn, win->xid);
 }
 
-void window_dispatch_events(struct window *win)
+/*
+ * Asks the owner of the selection to convert it into a property of the
+ * window. The content arrives with the next selection notify event.
+ */
+static void window_request_selection(struct window *win, int source)
+{
+    xcb_atom_t selection = XCB_ATOM_PRIMARY;
+
+    if (source == WIDGET_PASTE_CLIPBOARD)
+        selection = win->clipboard->atom;
+
+    (void) xcb_convert_selection(win->conn,
+                                 win->xid,
+                                 selection,
+                                 win->utf8_string->atom,
+                                 win->selection->atom,
+                                 XCB_CURRENT_TIME);
+}
+
+static void window_paste_selection(struct window *win,
+                                   xcb_selection_notify_event_t *ev)
+{
+    xcb_get_property_cookie_t cookie;
+    xcb_get_property_reply_t *reply;
+
+    /* The selection is empty or could not be converted */
+    if (ev->property == XCB_NONE)
+        return;
+
+    /* Only the beginning of the selection fits into the line edit */
+    cookie = xcb_get_property(win->conn,
+                              true, /* delete */
+                              win->xid,
+                              ev->property,
+                              XCB_GET_PROPERTY_TYPE_ANY,
+                              0,   /* long_offset */
+                              16); /* long_length */
+
+    reply = xcb_get_property_reply(win->conn, cookie, NULL);
+    if (!reply)
+        return;
+
+    widget_do_paste_event(&win->widget,
+                          xcb_get_property_value(reply),
+                          xcb_get_property_value_length(reply));
+
+    free(reply);
+}
+
+/* Damage of the canvas is pending until it is presented */
+static void window_add_damage(struct window *win, const struct damage *damage)
+{
+    int n = win->n_damage;
+
+    /* Damage which does not fit anymore is merged into the last box */
+    if (n < ARRAY_SIZE(win->damage))
+        win->damage[win->n_damage++] = *damage;
+    else
+        damage_add(&win->damage[n - 1],
+                   damage->x1,
+                   damage->y1,
+                   damage->x2,
+                   damage->y2);
+}
+
+static void window_put_shm(struct window *win, const struct damage *damage)
+{
+    size_t offset, len;
+
+    offset = damage->y1 * win->stride;
+    offset += damage->x1 * X11_WINDOW_BYTES_PER_PIXEL;
+    len = (damage->x2 - damage->x1) * X11_WINDOW_BYTES_PER_PIXEL;
+
+    for (uint32_t y = damage->y1; y < damage->y2; ++y) {
+        memcpy(win->shm + offset, win->canvas + offset, len);
+        offset += win->stride;
+    }
+
+    /* The completion event tells when the segment may be written again */
+    (void) xcb_shm_put_image(win->conn,
+                             win->xid,
+                             win->gc,
+                             win->width,
+                             win->height,
+                             damage->x1,
+                             damage->y1,
+                             damage->x2 - damage->x1,
+                             damage->y2 - damage->y1,
+                             damage->x1,
+                             damage->y1,
+                             win->screen->root_depth,
+                             XCB_IMAGE_FORMAT_Z_PIXMAP,
+                             true, /* send_event */
+                             win->shm_seg,
+                             0); /* offset */
+
+    ++win->shm_pending;
+}
+
+static void window_put_image(struct window *win, const struct damage *damage)
+{
+    uint32_t max, rows;
+
+    /* Whole rows are sent, as the image data has to be contiguous */
+    max = 4 * xcb_get_maximum_request_length(win->conn);
+    max -= sizeof(xcb_put_image_request_t);
+    rows = MAX(max / win->stride, 1);
+
+    for (uint32_t y = damage->y1; y < damage->y2; y += rows) {
+        uint32_t h = MIN(rows, damage->y2 - y);
+
+        (void) xcb_put_image(win->conn,
+                             XCB_IMAGE_FORMAT_Z_PIXMAP,
+                             win->xid,
+                             win->gc,
+                             win->width,
+                             h,
+                             0, /* dst_x */
+                             y,
+                             0, /* left_pad */
+                             win->screen->root_depth,
+                             h * win->stride,
+                             win->canvas + y * win->stride);
+    }
+}
+
+/* Sends the areas of the canvas the widget has drawn to */
+static void window_present(struct window *win)
+{
+    struct damage damage[WIDGET_DAMAGE_MAX];
+    int n;
+
+    TIMER_INIT_SIMPLE();
+
+    n = widget_take_damage(&win->widget, damage);
+
+    /* Cairo draws to the window directly */
+    if (!win->canvas)
+        return;
+
+    for (int i = 0; i < n; ++i)
+        window_add_damage(win, &damage[i]);
+
+    if (!win->n_damage || win->shm_pending)
+        return;
+
+    for (int i = 0; i < win->n_damage; ++i) {
+        if (win->shm)
+            window_put_shm(win, &win->damage[i]);
+        else
+            window_put_image(win, &win->damage[i]);
+    }
+
+    win->n_damage = 0;
+}
+
+static bool window_handle_event(struct window *win, xcb_generic_event_t *event)
 {
     union event {
         xcb_generic_event_t *generic;
@@ -368,55 +670,126 @@ void window_dispatch_events(struct window *win)
         xcb_key_release_event_t *key_release;
         xcb_focus_in_event_t *focus;
         xcb_visibility_notify_event_t *visibility;
+        xcb_selection_notify_event_t *selection;
     };
+    union event ev = {.generic = event};
+    struct key_event key_event;
+    xcb_keysym_t sym;
     bool active = true;
+    int paste;
 
-    while (active) {
-        union event ev;
-        struct key_event key_event;
-        xcb_keysym_t sym;
+    /* Extension events cannot be told apart by a constant */
+    if (win->shm && (ev.generic->response_type & 0x7f) == win->shm_event) {
+        --win->shm_pending;
+#ifdef MEM_NOLEAK
+        free(ev.generic);
+#endif
+        return true;
+    }
 
-        (void) xcb_flush(win->conn);
+    switch (ev.generic->response_type & 0x7f) {
+    case XCB_EXPOSE:
+        window_grab_focus(win);
 
-        ev.generic = xcb_wait_for_event(win->conn);
-        if (unlikely(!ev.generic))
-            die("lost x11 connection to the display manager\n");
+        widget_draw(&win->widget);
+        break;
+    case XCB_KEY_PRESS:
+        sym = xcb_key_press_lookup_keysym(win->symbols, ev.key_press, 0);
 
-        switch (ev.generic->response_type & 0x7f) {
-        case XCB_EXPOSE:
-            window_grab_focus(win);
+        key_event.symbol = (int) sym;
+        key_event.shift = !!(ev.key_press->state & XCB_MOD_MASK_SHIFT);
+        key_event.ctrl = !!(ev.key_press->state & XCB_MOD_MASK_CONTROL);
+        key_event.mod1 = !!(ev.key_press->state & XCB_MOD_MASK_1);
 
-            widget_draw(&win->widget);
+        paste = widget_paste_source(key_event);
+        if (paste != WIDGET_PASTE_NONE) {
+            window_request_selection(win, paste);
             break;
-        case XCB_KEY_PRESS:
-            sym = xcb_key_press_lookup_keysym(win->symbols, ev.key_press, 0);
+        }
 
-            key_event.symbol = (int) sym;
-            key_event.shift = !!(ev.key_press->state & XCB_MOD_MASK_SHIFT);
-            key_event.ctrl = !!(ev.key_press->state & XCB_MOD_MASK_CONTROL);
-            key_event.mod1 = !!(ev.key_press->state & XCB_MOD_MASK_1);
+        active = widget_do_key_event(&win->widget, key_event);
+        break;
+    case XCB_KEY_RELEASE:
+        break;
+    case XCB_SELECTION_NOTIFY:
+        window_paste_selection(win, ev.selection);
+        break;
+    case XCB_FOCUS_IN:
+        if (ev.focus->event != win->xid)
+            window_grab_focus(win);
 
-            active = widget_do_key_event(&win->widget, key_event);
-            break;
-        case XCB_KEY_RELEASE:
-            break;
-        case XCB_FOCUS_IN:
-            if (ev.focus->event != win->xid)
-                window_grab_focus(win);
+        break;
+    case XCB_VISIBILITY_NOTIFY:
+        if (ev.visibility->state != XCB_VISIBILITY_UNOBSCURED)
+            window_raise(win);
 
-            break;
-        case XCB_VISIBILITY_NOTIFY:
-            if (ev.visibility->state != XCB_VISIBILITY_UNOBSCURED)
-                window_raise(win);
-
-            break;
-        default:
-            break;
-        }
+        break;
+    default:
+        break;
+    }
 
 #ifdef MEM_NOLEAK
-        free(ev.generic);
+    free(ev.generic);
 #endif
+
+    return active;
+}
+
+void window_dispatch_events(struct window *win)
+{
+    struct pollfd fds[3];
+    bool active = true;
+
+    fds[0].fd = xcb_get_file_descriptor(win->conn);
+    fds[0].events = POLLIN;
+
+    fds[1].events = POLLIN;
+
+    fds[2].fd = widget_search_fd(&win->widget);
+    fds[2].events = POLLIN;
+
+    while (active) {
+        xcb_generic_event_t *event;
+        int n;
+
+        /* Handle all events already queued by xcb before going to sleep */
+        event = xcb_poll_for_event(win->conn);
+        if (event) {
+            active = window_handle_event(win, event);
+            continue;
+        }
+
+        if (unlikely(xcb_connection_has_error(win->conn)))
+            die("lost x11 connection to the display manager\n");
+
+        /*
+         * The queued events only changed the state of the widget. Draw
+         * all of their changes at once and send what was drawn.
+         */
+        widget_update(&win->widget);
+        window_present(win);
+
+        (void) xcb_flush(win->conn);
+
+        /*
+         * Negative file descriptors are ignored by poll(). The input is
+         * not watched while a lookup is running.
+         */
+        fds[1].fd = widget_input_fd(&win->widget);
+
+        n = poll(fds, ARRAY_SIZE(fds), -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            die("poll: %s\n", errstr(errno));
+        }
+
+        if (fds[1].revents)
+            widget_do_input_event(&win->widget);
+
+        if (fds[2].revents)
+            widget_do_search_event(&win->widget);
     }
 }
 
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2021   Steffen Nuessle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dfa.h"
+
+struct dfa_test {
+    const char *pattern;
+    const char *str;
+    bool match;
+};
+
+static const struct dfa_test tests[] = {
+    { "^[a-c]$", "b", true },
+    { "^[a-c]$", "d", false },
+    { "^[^a-c]$", "d", true },
+    { "^[\\d]$", "7", true },
+    { "^[\\Wx]$", "x", true },
+    { "^[\\Wx]$", "-", true },
+    { "^[\\Wx]$", "a", false },
+
+    /* Negated escapes must not invert the characters before them */
+    { "^[a\\D]$", "a", true },
+    { "^[a\\D]$", "b", true },
+    { "^[a\\D]$", "5", false },
+    { "^[5\\D]$", "5", true },
+    { "^[5\\D]$", "6", false },
+    { "^[_\\S]$", "_", true },
+    { "^[_\\S]$", " ", false },
+    { "^[a\\W]$", "a", true },
+    { "^[a\\W]$", "b", false },
+};
+
+int main(void)
+{
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(*tests); ++i) {
+        const struct dfa_test *t = &tests[i];
+        struct dfa dfa;
+        bool match;
+        int err;
+
+        dfa_init(&dfa);
+
+        err = dfa_compile(&dfa, t->pattern, strlen(t->pattern));
+        match = !err && dfa_match(&dfa, t->str, strlen(t->str));
+
+        if (match != t->match) {
+            fprintf(stderr,
+                    "\"%s\" on \"%s\": expected %d, got %d\n",
+                    t->pattern,
+                    t->str,
+                    t->match,
+                    match);
+            ++failed;
+        }
+
+        dfa_destroy(&dfa);
+    }
+
+    return failed ? 1 : 0;
+}